@@ -388,5 +388,13 @@ void PREFIX(random_init)(bool, bool);
 #ifdef HAVE_MPI
 MPI_Fint PREFIX(get_communicator)(caf_team_t *);
 #endif
+#ifdef GCC_GE_7
+int PREFIX(co_get_async)(void *, size_t, int, void *);
+int PREFIX(co_put_async)(void *, size_t, int, void *);
+void PREFIX(co_wait)(int);
+bool PREFIX(co_test)(int);
+void PREFIX(co_cache_begin)(void *);
+void PREFIX(co_cache_end)(void *);
+#endif
 
 #endif /* LIBCAF_H  */
@@ -27,6 +27,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <float.h>  /* For type conversion of floating point numbers. */
+#include <limits.h> /* For INT_MAX. */
 #include <stdarg.h> /* For variadic arguments. */
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,6 +40,7 @@
 #include <pthread.h>
 #include <signal.h> /* For raise */
 #include <stdint.h> /* For int32_t. */
+#include <time.h>   /* For nanosleep. */
 #include <unistd.h>
 
 #ifdef HAVE_MPI_EXT_H
@@ -112,6 +114,27 @@ typedef struct mpi_caf_token_t
   /* The pointer to the primary array, i.e., to coarrays that are arrays and
    * not a derived type. */
   gfc_descriptor_t *desc;
+  /* The displacement of memptr in memptr_win.  Zero, when the token has a
+   * window of its own, else the offset of the token's memory in the symmetric
+   * heap, which is the same on all images. */
+  MPI_Aint memptr_disp;
+  /* The number of bytes reserved for the token on the symmetric heap. */
+  size_t memptr_size;
+  /* For each rank of memptr_win the base address of the window's memory on
+   * that image mapped into this image's address space, or NULL when it can not
+   * be accessed directly.  NULL, when the token is not on the symmetric heap
+   * or the heap is not in shared memory. */
+  char **memptr_peers;
+  /* The ranks in memptr_win of the images indexed by their rank in the initial
+   * team, see win_ranks_create().  NULL, when the window spans the initial
+   * team. */
+  int *memptr_win_ranks;
+  /* The access plans compiled for the reference chains used with this token
+   * in the *_by_ref() routines, most recently used first. */
+  struct caf_ref_plan_t *ref_plans;
+  /* The number of bytes of the token's memory, when the data read from other
+   * images is kept in the read cache, else zero, see PREFIX(co_cache_begin). */
+  size_t cached_size;
 } mpi_caf_token_t;
 
 /* For components of derived type coarrays a slave_token is needed when the
@@ -153,12 +176,19 @@ typedef struct mpi_caf_slave_token_t
    * master data or the allocated component and is never stored at an address
    * not accessible by a window. */
   gfc_descriptor_t *desc;
+  /* The number of bytes allocated for memptr.  Needed to return the memory to
+   * the pool of global_dynamic_win. */
+  size_t memptr_size;
 } mpi_caf_slave_token_t;
 
 #define TOKEN(X) &(((mpi_caf_token_t *)(X))->memptr_win)
+#define TOKEN_DISP(X) (((mpi_caf_token_t *)(X))->memptr_disp)
+#define TOKEN_WIN_RANKS(X) (((mpi_caf_token_t *)(X))->memptr_win_ranks)
 #else
 typedef MPI_Win *mpi_caf_token_t;
 #define TOKEN(X) ((mpi_caf_token_t)(X))
+#define TOKEN_DISP(X) ((MPI_Aint)0)
+#define TOKEN_WIN_RANKS(X) ((int *)NULL)
 #endif
 
 /* Forward declaration of prototype. */
@@ -171,6 +201,16 @@ sync_images_internal(int count, int images[], int *stat, char *errmsg,
 static void
 error_stop_str(const char *string, size_t len, bool quiet)
     __attribute__((noreturn));
+#ifdef STRIDED
+static void
+datatype_cache_finalize(void);
+#endif
+#ifdef GCC_GE_7
+static void
+ref_plans_free(mpi_caf_token_t *token);
+static void
+alloc_epoch_bump(void);
+#endif
 
 /* Global variables. */
 static int caf_this_image;
@@ -195,35 +235,234 @@ MPI_Request *sync_handles;
 static int *arrived;
 static const int MPI_TAG_CAF_SYNC_IMAGES = 424242;
 
-/* Pending puts */
-#if defined(NONBLOCKING_PUT) && !defined(CAF_MPI_LOCK_UNLOCK)
-typedef struct win_sync
+/* Pending puts
+ * With non-blocking puts enabled a put only waits for the local completion of
+ * the transfer.  The images of a window with puts still in flight are recorded
+ * in the window's dirty set together with the extent of memory written.  They
+ * are flushed once each at the next image control statement or before another
+ * access to the image through the window, that may conflict with the puts.
+ *
+ * With write-combining enabled, puts of at most WRITE_COMBINE_MAX_PUT bytes
+ * are not issued at once, but their bytes are appended to a buffer of the
+ * (window, rank) pair.  Puts to adjacent memory are merged into one block.
+ * The buffer is issued as a single put with an hindexed datatype, when it is
+ * full, or when the pair is flushed. */
+#define WRITE_COMBINE_MAX_PUT 64
+#define WRITE_COMBINE_MAX_BLOCKS 256
+
+typedef struct pending_puts_wc
 {
-  MPI_Win *win;
-  int img;
-  struct win_sync *next;
-} win_sync;
+  /* The number of blocks and the bytes buffered. */
+  int count;
+  size_t bytes;
+  /* The extent [lo, hi) of the blocks. */
+  MPI_Aint lo, hi;
+  MPI_Aint disp[WRITE_COMBINE_MAX_BLOCKS];
+  int len[WRITE_COMBINE_MAX_BLOCKS];
+  /* The bytes of the blocks in order, caf_write_combine of them at most. */
+  char data[];
+} pending_puts_wc_t;
 
-static win_sync *last_elem = NULL;
-static win_sync *pending_puts = NULL;
-#endif
+typedef struct pending_puts_win
+{
+  MPI_Win win;
+  /* The number of dirty ranks and the list of them. */
+  int count;
+  int *ranks;
+  /* The extent [lo, hi) written by the pending puts indexed by the rank in
+   * the window.  hi is zero for clean ranks. */
+  MPI_Aint *lo, *hi;
+  /* The write-combining buffers indexed by the rank, NULL until used.  A rank
+   * with buffered puts is dirty even when its hi is zero. */
+  pending_puts_wc_t **wc;
+} pending_puts_win_t;
+
+static bool caf_nonblocking_put = false;
+/* The size of the write-combining buffers, zero when disabled. */
+static size_t caf_write_combine = 0;
+static pending_puts_win_t *pending_puts = NULL;
+static int pending_puts_wins = 0, pending_puts_capacity = 0;
+/* The number of dirty (window, rank) pairs over all windows. */
+static int pending_puts_dirty = 0;
+
+/* Asynchronous transfers
+ * The requests of the transfers started by PREFIX(co_get_async) and
+ * PREFIX(co_put_async), that have not been completed yet.  A transfer has one
+ * request per chunk of transfer_chunk_size() bytes.  A handle combines the
+ * index of the transfer's slot in async_requests with the slot's generation,
+ * which is advanced each time the slot is used, so that a stale handle does
+ * not refer to a later transfer.  Slots not in use have their win set to
+ * MPI_WIN_NULL. */
+#define ASYNC_HANDLE_SLOT_BITS 16
+#define ASYNC_HANDLE_GENERATION_MASK 0x7fff
+
+typedef struct async_request
+{
+  MPI_Request *requests;
+  int count, capacity;
+  MPI_Win win;
+  /* The target rank of a put, which is in the dirty set of win until
+   * completed, or -1 for gets. */
+  int put_rank;
+  int generation;
+} async_request_t;
+
+static async_request_t *async_requests = NULL;
+static int async_requests_size = 0, async_requests_active = 0;
+
+/* Registry of the tokens allocated by the library.  Do not expose to public
+ * in the header, because it is implementation specific.
+ * The entries form a doubly linked list in the order of registration, because
+ * finalize has to free the windows in the same order on all images.  An open
+ * addressing hash table with linear probing maps the address of a token to its
+ * entry, so that deregister finds and removes a token in constant time.  The
+ * entries holding memory are also kept ordered by the address of the memory,
+ * so that the token of an address is found by a binary search. */
+struct caf_token_entry_t
+{
+  void *token;
+  /* The local memory of the token and its size in bytes. */
+  void *mem;
+  size_t size;
+  struct caf_token_entry_t *prev, *next;
+};
 
-/* Linked list of static coarrays registered.  Do not expose to public in the
- * header, because it is implementation specific. */
-struct caf_allocated_tokens_t
+struct caf_token_registry_t
 {
-  caf_token_t token;
-  struct caf_allocated_tokens_t *prev;
-} *caf_allocated_tokens = NULL;
+  /* The oldest and the most recently registered entry. */
+  struct caf_token_entry_t *first, *last;
+  /* The hash table.  The capacity is always a power of two. */
+  struct caf_token_entry_t **slots;
+  size_t capacity;
+  /* The number of slots in use, including the ones of removed entries. */
+  size_t used;
+  /* The number of live tokens and the bytes of memory held by them. */
+  size_t count, bytes;
+  /* The entries with memory ordered by its address. */
+  struct caf_token_entry_t **by_mem;
+  size_t by_mem_count, by_mem_capacity;
+};
+
+/* Marks a slot of a removed entry in the hash table. */
+static struct caf_token_entry_t token_registry_removed;
+
+/* The registered tokens of static and allocatable coarrays. */
+static struct caf_token_registry_t caf_allocated_tokens;
 
 #ifdef GCC_GE_7
-/* Linked list of slave coarrays registered. */
-struct caf_allocated_slave_tokens_t
+/* The registered slave tokens of components of derived type coarrays. */
+static struct caf_token_registry_t caf_allocated_slave_tokens;
+
+/* The allocation epoch.
+ * Each image counts how often it registered or deregistered memory and
+ * exposes the count to the other images through alloc_epoch_win.  The remote
+ * meta data cached by the *_by_ref() routines is dropped, when the image it
+ * was fetched from has moved on to a new epoch.  Another image's allocation
+ * status can only change in a way visible to this image across an image
+ * control statement, therefore each image's epoch is checked at most once per
+ * segment.  caf_segment counts the segments of this image. */
+static uint64_t caf_alloc_epoch = 0;
+static MPI_Win alloc_epoch_win = MPI_WIN_NULL;
+static unsigned long caf_segment = 1;
+/* For each image of the initial team the epoch seen last and the segment it
+ * was checked in. */
+static struct alloc_epoch_seen_t
 {
-  mpi_caf_slave_token_t *token;
-  struct caf_allocated_slave_tokens_t *prev;
-} *caf_allocated_slave_tokens = NULL;
-#endif
+  uint64_t epoch;
+  unsigned long segment;
+} *alloc_epoch_seen = NULL;
+
+/* The symmetric heap.
+ * A single window allocated in init() from which the memory of all coarrays
+ * registered in the initial team is carved.  Registering and deregistering
+ * coarrays is collective, therefore the first fit allocator below computes
+ * the same offsets on all images without any communication.  Tokens on the
+ * heap store the heap's window in memptr_win and their offset in memptr_disp.
+ * When the heap is disabled or exhausted, or the coarray is registered in a
+ * team, the token gets a window of its own. */
+static MPI_Win symmetric_heap_win = MPI_WIN_NULL;
+static void *symmetric_heap_base = NULL;
+
+/* Default size of the symmetric heap in bytes.  Can be overridden by the
+ * environment variable OPENCOARRAYS_SYMMETRIC_HEAP_SIZE, which also accepts a
+ * K, M or G suffix.  A size of zero disables the heap. */
+static const size_t SYMMETRIC_HEAP_DEFAULT_SIZE = (size_t)64 << 20;
+
+/* All blocks on the heap are aligned to a cache line. */
+static const size_t SYMMETRIC_HEAP_ALIGN = 64;
+
+/* Shared memory for the images on the same node.
+ * Unless OPENCOARRAYS_SHARED_MEMORY is set to 0, the memory of the symmetric
+ * heap is allocated with MPI_Win_allocate_shared on caf_node_comm, the images
+ * sharing a node with this one.  symmetric_heap_peers then holds for every
+ * image of the initial team the base address of its heap in this image's
+ * address space, or NULL for images on other nodes.  Transfers from and to
+ * node-local images are done by memcpy instead of one-sided communication. */
+static MPI_Comm caf_node_comm = MPI_COMM_NULL;
+static MPI_Win symmetric_heap_shm_win = MPI_WIN_NULL;
+static char **symmetric_heap_peers = NULL;
+
+/* Free extents on the symmetric heap ordered by increasing offset. */
+struct symmetric_heap_extent_t
+{
+  MPI_Aint offset;
+  size_t size;
+  struct symmetric_heap_extent_t *next;
+} *symmetric_heap_free = NULL;
+
+/* The pool of memory attached to global_dynamic_win.
+ * Attaching memory to and detaching it from a dynamic window is expensive.
+ * Therefore slave tokens and allocatable components of at most
+ * DYNAMIC_POOL_MAX_BLOCK bytes are handed out from slabs, that are attached
+ * once and only detached in finalize.  Each size class, a power of two, has
+ * its own slabs and a list of free blocks.  Larger components are attached
+ * individually. */
+#define DYNAMIC_POOL_NUM_CLASSES 10
+static const size_t DYNAMIC_POOL_MIN_BLOCK = 16;
+static const size_t DYNAMIC_POOL_MAX_BLOCK
+    = (size_t)16 << (DYNAMIC_POOL_NUM_CLASSES - 1);
+static const size_t DYNAMIC_POOL_SLAB_SIZE = (size_t)64 << 10;
+
+/* Linked list of the slabs attached to global_dynamic_win. */
+struct dynamic_pool_slab_t
+{
+  void *mem;
+  struct dynamic_pool_slab_t *next;
+} *dynamic_pool_slabs = NULL;
+
+/* The free blocks of each size class.  The pointer to the next free block is
+ * stored in the first bytes of the block. */
+static void *dynamic_pool_free[DYNAMIC_POOL_NUM_CLASSES];
+#endif
+
+/* The pool of staging buffers.
+ * The temporaries of the transfers, i.e., for type conversion, padding and the
+ * messages to the communication thread, are taken from buffers obtained by
+ * MPI_Alloc_mem, which the MPI implementation may register for RMA once.  The
+ * stack is no option for them, because large arrays overflow it.  Released
+ * buffers of at most BOUNCE_POOL_MAX_BLOCK bytes are kept in a free list per
+ * size class, a power of two, for reuse.  Larger buffers are freed on
+ * release.  Only the main thread uses the pool. */
+#define BOUNCE_POOL_NUM_CLASSES 17
+static const size_t BOUNCE_POOL_MIN_BLOCK = 256;
+static const size_t BOUNCE_POOL_MAX_BLOCK
+    = (size_t)256 << (BOUNCE_POOL_NUM_CLASSES - 1);
+
+/* The header in front of each buffer of the pool. */
+union bounce_buffer_t
+{
+  struct
+  {
+    /* The next free buffer of the size class. */
+    union bounce_buffer_t *next;
+    /* The size class or BOUNCE_POOL_NUM_CLASSES for a large buffer. */
+    int cls;
+  } h;
+  /* Align the data following the header for any type. */
+  long double align;
+};
+
+static union bounce_buffer_t *bounce_pool_free[BOUNCE_POOL_NUM_CLASSES];
 
 /* Image status variable */
 static int img_status = 0;
@@ -238,12 +477,31 @@ char *msgbody;
 pthread_mutex_t lock_am;
 int done_am = 0;
 
-#ifdef GCC_GE_15
+/* The communication thread executes requests of other images on this one.
+ * With gfortran 15 it runs the accessors of the remote accesses.  For all
+ * versions it does the third party transfers of sendget between coarrays on
+ * the symmetric heap, see sendget_third_party(). */
+#if defined(GCC_GE_7) && MPI_VERSION >= 3
+#define WITH_COMM_THREAD
+#endif
+
+#ifdef WITH_COMM_THREAD
 /* Communication thread variables, constants and structures. */
 static const int CAF_CT_TAG = 13;
+/* The tag of the requests larger than CT_RECV_BUFFER_SIZE bytes. */
+static const int CAF_CT_LARGE_TAG = 15;
 pthread_t commthread;
 MPI_Comm ct_COMM;
 bool commthread_running = true;
+/* Set when the thread has been started.  Before gfortran 15 this is done only
+ * when the third party transfers can be used, i.e., in the lock_all epoch
+ * model with MPI_THREAD_MULTIPLE. */
+static bool commthread_started = false;
+
+typedef ptrdiff_t rat_id_t;
+#endif
+
+#ifdef GCC_GE_15
 enum CT_MSG_FLAGS
 {
   CT_DST_HAS_DESC = 1,
@@ -251,7 +509,8 @@ enum CT_MSG_FLAGS
   CT_CHAR_ARRAY = 1 << 2,
   CT_INCLUDE_DESCRIPTOR = 1 << 3,
   CT_TRANSFER_DESC = 1 << 4,
-  /* Use 1 << 5 for next flag. */
+  CT_RESULT_HEADER = 1 << 5,
+  /* Use 1 << 6 for next flag. */
 };
 
 typedef void (*getter_t)(void *, const int *, void **, int32_t *, void *,
@@ -283,16 +542,25 @@ static enum
   AHT_PREPARED
 } accessor_hash_table_state = AHT_UNINITIALIZED;
 
-typedef ptrdiff_t rat_id_t;
+/* The accesses of this image, whose accessors get their data with the
+ * message and not from a window, see running_access_register().  The table
+ * is indexed by the low bits of the ids; the high bits count the uses of the
+ * slot.  Only the main thread registers accesses, the communication thread and
+ * its workers look them up.  A slot's id is 0, while it is unused. */
+#define RUNNING_ACCESSES_SLOTS 64
+
 static struct running_accesses_t
 {
   rat_id_t id;
   void *memptr;
-  struct running_accesses_t *next;
-} *running_accesses = NULL;
-
-static rat_id_t running_accesses_id_cnt = 0;
+  rat_id_t generation;
+} running_accesses[RUNNING_ACCESSES_SLOTS];
+/* The slots in use or released so far and the stack of the released ones. */
+static int running_accesses_used = 0, running_accesses_nfree = 0;
+static int running_accesses_free[RUNNING_ACCESSES_SLOTS];
+#endif
 
+#ifdef WITH_COMM_THREAD
 enum remote_command
 {
   remote_command_unset = 0,
@@ -300,6 +568,7 @@ enum remote_command
   remote_command_present,
   remote_command_send,
   remote_command_transfer,
+  remote_command_sendget,
 };
 
 /* The structure to communicate with the communication thread. Make sure, that
@@ -311,6 +580,7 @@ typedef struct
   size_t transfer_size;
   size_t opt_charlen;
   MPI_Win win;
+  MPI_Aint win_disp;
   int dest_image;
   int dest_tag;
   int accessor_index;
@@ -319,6 +589,23 @@ typedef struct
   char data[];
 } ct_msg_t;
 
+/* The data of a remote_command_sendget message.  The image receiving it puts
+ * the elements at win_disp of its part of the symmetric heap to dst_disp of
+ * the part of image dest_image and acknowledges to the sender of the message
+ * with a byte holding the stat on dest_tag in CAF_COMM_WORLD.  The size of an
+ * element is in transfer_size.  Dims holds the extents of the src_rank
+ * dimensions of the source followed by their strides in bytes, then the same
+ * for the dst_rank dimensions of the destination. */
+struct sendget_msg_data_t
+{
+  MPI_Aint dst_disp;
+  int src_rank;
+  int dst_rank;
+  ptrdiff_t dims[];
+};
+#endif
+
+#ifdef GCC_GE_15
 struct transfer_msg_data_t
 {
   size_t dst_msg_size;
@@ -338,6 +625,28 @@ typedef struct gfc_max_dim_descriptor_t
   descriptor_dimension dim[GFC_MAX_DIMENSIONS];
 } gfc_max_dim_descriptor_t;
 
+#ifdef GCC_GE_15
+/* The header of the result of a remote_command_get with CT_RESULT_HEADER.  It
+ * holds the destination's descriptor, when CT_INCLUDE_DESCRIPTOR is set, and
+ * only the desc_size bytes of desc used are sent.  The data_size bytes of data
+ * follow in a message of their own or, when landing is set, are put by the
+ * remote image into the memory the initiator attaches to ct_landing_win for
+ * them and whose address and rank it sends with CAF_CT_LANDING_TAG in ct_COMM.
+ * The completion of the put is acknowledged with a byte holding the stat. */
+struct ct_result_t
+{
+  size_t data_size;
+  size_t desc_size;
+  int landing;
+  gfc_max_dim_descriptor_t desc;
+};
+
+/* Results larger than this are put into the initiator's memory. */
+#define CT_LANDING_THRESHOLD ((size_t)64 << 10)
+static const int CAF_CT_LANDING_TAG = 16;
+static MPI_Win ct_landing_win = MPI_WIN_NULL;
+#endif
+
 char err_buffer[MPI_MAX_ERROR_STRING];
 
 /* All CAF runtime calls should use this comm instead of MPI_COMM_WORLD for
@@ -347,6 +656,16 @@ MPI_Comm CAF_COMM_WORLD;
 static caf_teams_list *teams_list = NULL;
 static caf_used_teams_list *used_teams = NULL;
 
+/* Rank translation from teams to windows.
+ * Every remote access has to translate the rank of the image in the current
+ * team into the rank in the group of the window accessed.  Instead of asking
+ * MPI for each access, caf_team_ranks maps the ranks of the current team to
+ * ranks in the initial team, and a window's rank table maps those to ranks in
+ * the window.  Both are NULL when no translation is needed, i.e., in the
+ * initial team and for windows spanning it. */
+static MPI_Group caf_initial_group = MPI_GROUP_NULL;
+static int *caf_team_ranks = NULL;
+
 /* Emitted when a theorectically unreachable part is reached. */
 const char unreachable[] = "Fatal error: unreachable alternative found.\n";
 
@@ -405,26 +724,38 @@ int64_t (*int64_t_by_value)(int64_t, int64_t);
 float (*float_by_value)(float, float);
 double (*double_by_value)(double, double);
 
-/* Define shortcuts for Win_lock and _unlock depending on whether the primitives
- * are available in the MPI implementation.  When they are not available the
- * shortcut is expanded to nothing by the preprocessor else to the API call.
- * This prevents having #ifdef #else #endif constructs strewn all over the code
- * reducing its readability. */
-// #ifdef CAF_MPI_LOCK_UNLOCK
+/* The passive target epoch model used for remote accesses.  With the lock
+ * model each access is enclosed in its own MPI_Win_lock/_unlock epoch.  With
+ * the lock_all model every window is locked for all images once when it is
+ * created and accesses are completed by MPI_Win_flush, or MPI_Win_flush_local
+ * when only the origin buffer needs to be ready, i.e., for gets.  Selected by
+ * the environment variable OPENCOARRAYS_EPOCH_MODEL at initialization, see
+ * epoch_model_init().  The lock_all model needs MPI 3. */
+static bool caf_epoch_lock_all = false;
+
+/* Define shortcuts for Win_lock and _unlock depending on the epoch model.
+ * This prevents having if/else constructs strewn all over the code reducing
+ * its readability.  All shortcuts evaluate to an MPI error code. */
+#if MPI_VERSION >= 3
+#define CAF_Win_lock(type, img, win)                                           \
+  (caf_epoch_lock_all ? pending_puts_complete(win, img)                        \
+                      : MPI_Win_lock(type, img, 0, win))
+#define CAF_Win_unlock(img, win)                                               \
+  (caf_epoch_lock_all ? MPI_Win_flush(img, win) : MPI_Win_unlock(img, win))
+#define CAF_Win_unlock_local(img, win)                                         \
+  (caf_epoch_lock_all ? MPI_Win_flush_local(img, win)                          \
+                      : MPI_Win_unlock(img, win))
+#define CAF_Win_lock_all(win)                                                  \
+  (caf_epoch_lock_all ? MPI_Win_lock_all(MPI_MODE_NOCHECK, win) : MPI_SUCCESS)
+#define CAF_Win_unlock_all(win)                                                \
+  (caf_epoch_lock_all ? MPI_Win_unlock_all(win) : MPI_SUCCESS)
+#else
 #define CAF_Win_lock(type, img, win) MPI_Win_lock(type, img, 0, win)
 #define CAF_Win_unlock(img, win) MPI_Win_unlock(img, win)
-#define CAF_Win_lock_all(win)
-#define CAF_Win_unlock_all(win)
-// #else // CAF_MPI_LOCK_UNLOCK
-// #define CAF_Win_lock(type, img, win)
-// #define CAF_Win_unlock(img, win) MPI_Win_flush (img, win)
-// #if MPI_VERSION >= 3
-// #define CAF_Win_lock_all(win) MPI_Win_lock_all (MPI_MODE_NOCHECK, win)
-// #else
-// #define CAF_Win_lock_all(win)
-// #endif
-// #define CAF_Win_unlock_all(win) MPI_Win_unlock_all (win)
-// #endif // CAF_MPI_LOCK_UNLOCK
+#define CAF_Win_unlock_local(img, win) MPI_Win_unlock(img, win)
+#define CAF_Win_lock_all(win) MPI_SUCCESS
+#define CAF_Win_unlock_all(win) MPI_SUCCESS
+#endif // MPI_VERSION
 
 /* Convenience macro to get the extent of a descriptor in a certain dimension
  *
@@ -436,27 +767,386 @@ double (*double_by_value)(double, double);
   (sizeof(gfc_descriptor_t) + (rank) * sizeof(descriptor_dimension))
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
 
-#if defined(NONBLOCKING_PUT) && !defined(CAF_MPI_LOCK_UNLOCK)
-void
-explicit_flush()
+#if MPI_VERSION >= 3
+/* Return the dirty set of win.  When create is set, a missing set is
+ * created, else NULL is returned for it. */
+static pending_puts_win_t *
+pending_puts_find(MPI_Win win, bool create)
 {
-  win_sync *w = pending_puts, *t;
-  MPI_Win *p;
+  static int last = 0;
+  pending_puts_win_t *pw;
+
+  if (last < pending_puts_wins && pending_puts[last].win == win)
+    return &pending_puts[last];
+  for (last = 0; last < pending_puts_wins; ++last)
+    if (pending_puts[last].win == win)
+      return &pending_puts[last];
+  if (!create)
+    return NULL;
+
+  if (pending_puts_wins == pending_puts_capacity)
+  {
+    pending_puts_capacity = pending_puts_capacity ? 2 * pending_puts_capacity
+                                                  : 4;
+    pending_puts = realloc(pending_puts, pending_puts_capacity
+                                             * sizeof(pending_puts_win_t));
+  }
+  last = pending_puts_wins++;
+  pw = &pending_puts[last];
+  pw->win = win;
+  pw->count = 0;
+  /* No window spans more images than the initial team. */
+  pw->ranks = malloc(global_num_images * sizeof(int));
+  pw->lo = calloc(global_num_images, sizeof(MPI_Aint));
+  pw->hi = calloc(global_num_images, sizeof(MPI_Aint));
+  pw->wc = caf_write_combine
+               ? calloc(global_num_images, sizeof(pending_puts_wc_t *))
+               : NULL;
+  return pw;
+}
+
+/* Return the write-combining buffer of rank in pw, when it holds puts, else
+ * NULL. */
+static inline pending_puts_wc_t *
+pending_puts_wc(pending_puts_win_t *pw, int rank)
+{
+  return (pw->wc && pw->wc[rank] && pw->wc[rank]->count) ? pw->wc[rank]
+                                                          : NULL;
+}
+
+/* Add rank to the dirty list of pw, unless it is in it. */
+static void
+pending_puts_mark(pending_puts_win_t *pw, int rank)
+{
+  if (pw->hi[rank] != 0 || pending_puts_wc(pw, rank))
+    return;
+  pw->ranks[pw->count++] = rank;
+  ++pending_puts_dirty;
+}
+
+/* Record a put to [disp, end) on rank in flight in pw. */
+static void
+pending_puts_record(pending_puts_win_t *pw, int rank, MPI_Aint disp,
+                    MPI_Aint end)
+{
+  pending_puts_mark(pw, rank);
+  if (pw->hi[rank] == 0)
+  {
+    pw->lo[rank] = disp;
+    pw->hi[rank] = end;
+  }
+  else
+  {
+    pw->lo[rank] = MIN(pw->lo[rank], disp);
+    pw->hi[rank] = MAX(pw->hi[rank], end);
+  }
+}
+
+/* Issue the puts buffered for rank in pw as one put.  The blocks in
+ * global_dynamic_win may be in different attached memory, which a single put
+ * must not span, therefore each is put on its own there. */
+static int
+pending_puts_wc_issue(pending_puts_win_t *pw, int rank)
+{
+  pending_puts_wc_t *wc = pw->wc[rank];
+  MPI_Datatype dt;
+  size_t offset;
+  int ierr = MPI_SUCCESS, i;
+
+  if (wc->count == 1)
+    ierr = MPI_Put(wc->data, wc->bytes, MPI_BYTE, rank, wc->disp[0],
+                   wc->bytes, MPI_BYTE, pw->win);
+  else if (pw->win == global_dynamic_win)
+    for (i = 0, offset = 0; i < wc->count && ierr == MPI_SUCCESS;
+         offset += wc->len[i++])
+      ierr = MPI_Put(wc->data + offset, wc->len[i], MPI_BYTE, rank,
+                     wc->disp[i], wc->len[i], MPI_BYTE, pw->win);
+  else
+  {
+    /* The displacements of the datatype are relative to the lowest one. */
+    for (i = 0; i < wc->count; ++i)
+      wc->disp[i] -= wc->lo;
+    ierr = MPI_Type_create_hindexed(wc->count, wc->len, wc->disp, MPI_BYTE,
+                                    &dt);
+    chk_err(ierr);
+    ierr = MPI_Type_commit(&dt);
+    chk_err(ierr);
+    ierr = MPI_Put(wc->data, wc->bytes, MPI_BYTE, rank, wc->lo, 1, dt,
+                   pw->win);
+    chk_err(ierr);
+    MPI_Type_free(&dt);
+  }
+  chk_err(ierr);
+  /* The buffer is reused for the next puts. */
+  ierr = MPI_Win_flush_local(rank, pw->win);
+  chk_err(ierr);
+  dprint("Issued %d combined blocks of %zd bytes to rank %d.\n", wc->count,
+         wc->bytes, rank);
+  /* The puts are in flight now like the ones issued directly. */
+  if (pw->hi[rank] == 0)
+  {
+    pw->lo[rank] = wc->lo;
+    pw->hi[rank] = wc->hi;
+  }
+  else
+  {
+    pw->lo[rank] = MIN(pw->lo[rank], wc->lo);
+    pw->hi[rank] = MAX(pw->hi[rank], wc->hi);
+  }
+  wc->count = 0;
+  wc->bytes = 0;
+  return ierr;
+}
+
+/* Flush the pending puts to the rank at index i of the dirty list of pw. */
+static int
+pending_puts_flush_one(pending_puts_win_t *pw, int i)
+{
+  const int rank = pw->ranks[i];
+  int ierr;
+
+  if (pending_puts_wc(pw, rank))
+    pending_puts_wc_issue(pw, rank);
+  ierr = MPI_Win_flush(rank, pw->win);
+  chk_err(ierr);
+  pw->lo[rank] = pw->hi[rank] = 0;
+  pw->ranks[i] = pw->ranks[--pw->count];
+  --pending_puts_dirty;
+  return ierr;
+}
+
+/* Complete the pending puts to rank through win, before accessing it. */
+static int
+pending_puts_complete(MPI_Win win, int rank)
+{
+  pending_puts_win_t *pw;
+  int i;
+
+  if (pending_puts_dirty == 0 || (pw = pending_puts_find(win, false)) == NULL
+      || (pw->hi[rank] == 0 && !pending_puts_wc(pw, rank)))
+    return MPI_SUCCESS;
+  for (i = 0; pw->ranks[i] != rank; ++i)
+    ;
+  return pending_puts_flush_one(pw, i);
+}
+
+/* Complete all pending puts. */
+static void
+pending_puts_flush(void)
+{
+  int i;
+
+  for (i = 0; pending_puts_dirty && i < pending_puts_wins; ++i)
+    while (pending_puts[i].count)
+      pending_puts_flush_one(&pending_puts[i], pending_puts[i].count - 1);
+}
+
+/* Drop the dirty set of win, which is about to be freed.  Freeing the window
+ * completes all puts to it. */
+static void
+pending_puts_forget(MPI_Win win)
+{
+  pending_puts_win_t *pw = pending_puts_find(win, false);
+
+  if (pw == NULL)
+    return;
+  pending_puts_dirty -= pw->count;
+  free(pw->ranks);
+  free(pw->lo);
+  free(pw->hi);
+  if (pw->wc)
+  {
+    int i;
+    for (i = 0; i < global_num_images; ++i)
+      free(pw->wc[i]);
+    free(pw->wc);
+  }
+  *pw = pending_puts[--pending_puts_wins];
+}
+
+/* Flush the puts to rank in pw, when they overlap [disp, end).  Puts to
+ * overlapping memory are not ordered in the same epoch. */
+static void
+pending_puts_order(pending_puts_win_t *pw, int rank, MPI_Aint disp,
+                   MPI_Aint end)
+{
+  pending_puts_wc_t *wc = pending_puts_wc(pw, rank);
+  int i;
+
+  if ((pw->hi[rank] != 0 && disp < pw->hi[rank] && pw->lo[rank] < end)
+      || (wc && disp < wc->hi && wc->lo < end))
+  {
+    for (i = 0; pw->ranks[i] != rank; ++i)
+      ;
+    pending_puts_flush_one(pw, i);
+  }
+}
+
+/* Append the put of size bytes from buf to displacement disp on rank to the
+ * write-combining buffer of pw.  A put to the same memory as a buffered one
+ * replaces the buffered bytes, when both match exactly. */
+static int
+pending_puts_combine(pending_puts_win_t *pw, int rank, MPI_Aint disp,
+                     const void *buf, size_t size)
+{
+  pending_puts_wc_t *wc = pw->wc[rank];
+  const MPI_Aint end = disp + (MPI_Aint)size;
+  size_t offset;
+  int ierr = MPI_SUCCESS, i;
+
+  if (wc == NULL)
+    wc = pw->wc[rank]
+        = calloc(1, sizeof(pending_puts_wc_t) + caf_write_combine);
+
+  if (wc->count && disp < wc->hi && wc->lo < end)
+  {
+    for (i = 0, offset = 0; i < wc->count; offset += wc->len[i++])
+      if (disp < wc->disp[i] + wc->len[i] && wc->disp[i] < end)
+        break;
+    if (i < wc->count && disp >= wc->disp[i] && end <= wc->disp[i] + wc->len[i])
+    {
+      memcpy(wc->data + offset + (disp - wc->disp[i]), buf, size);
+      return MPI_SUCCESS;
+    }
+  }
+  /* Puts overlapping the buffered ones only partially, or the ones in
+   * flight, and puts not fitting into the buffer issue the buffer first. */
+  pending_puts_order(pw, rank, disp, end);
+  if ((wc->count == WRITE_COMBINE_MAX_BLOCKS
+       && wc->disp[wc->count - 1] + wc->len[wc->count - 1] != disp)
+      || wc->bytes + size > caf_write_combine)
+    ierr = pending_puts_wc_issue(pw, rank);
+
+  pending_puts_mark(pw, rank);
+  if (wc->count && wc->disp[wc->count - 1] + wc->len[wc->count - 1] == disp)
+    wc->len[wc->count - 1] += size;
+  else
+  {
+    wc->disp[wc->count] = disp;
+    wc->len[wc->count++] = size;
+  }
+  memcpy(wc->data + wc->bytes, buf, size);
+  wc->bytes += size;
+  if (wc->bytes == size)
+  {
+    wc->lo = disp;
+    wc->hi = end;
+  }
+  else
+  {
+    wc->lo = MIN(wc->lo, disp);
+    wc->hi = MAX(wc->hi, end);
+  }
+  return ierr;
+}
+
+/* Start a put of size bytes from buf to displacement disp of win on rank and
+ * return without waiting for its remote completion. */
+static int
+pending_puts_put(MPI_Win win, int rank, MPI_Aint disp, const void *buf,
+                 size_t size)
+{
+  pending_puts_win_t *pw = pending_puts_find(win, true);
+  const MPI_Aint end = disp + (MPI_Aint)size;
+  int ierr;
+
+  if (size == 0)
+    return MPI_SUCCESS;
+  if (pw->wc && size <= WRITE_COMBINE_MAX_PUT)
+    return pending_puts_combine(pw, rank, disp, buf, size);
+
+  pending_puts_order(pw, rank, disp, end);
+  ierr = MPI_Put(buf, size, MPI_BYTE, rank, disp, size, MPI_BYTE, win);
+  chk_err(ierr);
+  ierr = MPI_Win_flush_local(rank, win);
+  chk_err(ierr);
+  pending_puts_record(pw, rank, disp, end);
+  return ierr;
+}
+
+/* Complete the asynchronous transfer in slot of async_requests and free the
+ * slot. */
+static void
+async_request_complete(int slot)
+{
+  async_request_t *ar = &async_requests[slot];
   int ierr;
-  while (w != NULL)
+
+  ierr = MPI_Waitall(ar->count, ar->requests, MPI_STATUSES_IGNORE);
+  chk_err(ierr);
+  /* A put is complete at the target after flushing, unless an access
+   * conflicting with it has done so already. */
+  if (ar->put_rank >= 0)
   {
-    p = w->win;
-    ierr = MPI_Win_flush(w->img, *p);
+    ierr = pending_puts_complete(ar->win, ar->put_rank);
     chk_err(ierr);
-    t = w;
-    w = w->next;
-    free(t);
   }
-  last_elem = NULL;
-  pending_puts = NULL;
+  ar->win = MPI_WIN_NULL;
+  --async_requests_active;
+}
+#else
+#define pending_puts_flush()
+#define pending_puts_forget(win)
+#endif // MPI_VERSION
+
+#if MPI_VERSION >= 3
+/* Synchronize the public and private copy of the window win.  MPI_Win_sync
+ * needs a passive target epoch, which with the lock epoch model, or for a
+ * window never locked otherwise, is opened for the call only. */
+static void
+shared_memory_win_sync(MPI_Win win, bool locked)
+{
+  int ierr;
+
+  if (!locked)
+  {
+    ierr = MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    chk_err(ierr);
+  }
+  ierr = MPI_Win_sync(win);
+  chk_err(ierr);
+  if (!locked)
+  {
+    ierr = MPI_Win_unlock_all(win);
+    chk_err(ierr);
+  }
+}
+#endif // MPI_VERSION
+
+/* Order the loads and stores done through shared memory with respect to the
+ * one-sided communication and the image control statements. */
+static void
+shared_memory_fence(void)
+{
+#if MPI_VERSION >= 3
+  if (!symmetric_heap_peers)
+    return;
+  shared_memory_win_sync(symmetric_heap_win, caf_epoch_lock_all);
+  if (symmetric_heap_shm_win != symmetric_heap_win)
+    shared_memory_win_sync(symmetric_heap_shm_win, false);
+#endif
 }
+
+/* Complete all pending accesses, i.e., the asynchronous transfers and the
+ * non-blocking puts.  Called by all image control statements. */
+static void
+pending_accesses_complete(void)
+{
+#if MPI_VERSION >= 3
+  int i;
+
+  for (i = 0; async_requests_active && i < async_requests_size; ++i)
+    if (async_requests[i].win != MPI_WIN_NULL)
+      async_request_complete(i);
+#endif
+  pending_puts_flush();
+  shared_memory_fence();
+#ifdef GCC_GE_7
+  ++caf_segment;
 #endif
+}
 
 #ifdef HELPER
 void
@@ -606,7 +1296,162 @@ compute_arr_data_size(const gfc_descriptor_t *desc)
   return compute_arr_data_size_sz(desc, desc->span);
 }
 
+#ifdef WITH_COMM_THREAD
+/* The replies of the communication thread and its workers to the images whose
+ * requests they executed.  They are sent non-blocking, the requests are
+ * completed by ct_replies_progress() on the communication thread, which frees
+ * the buffers that are owned by the replies then. */
+static struct ct_reply_t
+{
+  MPI_Request request;
+  void *to_free;
+} *ct_replies = NULL;
+static int ct_replies_count = 0, ct_replies_cap = 0;
+static pthread_mutex_t ct_replies_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The bytes of the acknowledgements, which report success or failure. */
+static const char ct_ack[2] = {0, 1};
+
+/* The receive buffers of the communication thread
+ * Requests of up to CT_RECV_BUFFER_SIZE bytes are sent with CAF_CT_TAG and
+ * received into one of CT_RECV_BUFFERS buffers, for each of which a
+ * persistent receive is posted, while it is not in use.  Larger requests are
+ * sent with CAF_CT_LARGE_TAG.  The communication thread probes for them and
+ * receives them into one of CT_LARGE_BUFFERS buffers, which are kept for the
+ * next large requests and grown to the power of two fitting a request, when
+ * none is large enough.  Only while all of them are in use by the workers, a
+ * request is received into memory of its own.  All buffers are allocated by
+ * MPI_Alloc_mem, so that the MPI library can register them once.  Thus no
+ * request is received on the stack of a thread and no memory is allocated for
+ * most of them. */
+#define CT_RECV_BUFFERS 8
+#define CT_RECV_BUFFER_SIZE ((size_t)64 << 10)
+#define CT_LARGE_BUFFERS 4
+
+static char *ct_recv_buffers[CT_RECV_BUFFERS];
+static MPI_Request ct_recv_requests[CT_RECV_BUFFERS];
+/* Set by the thread that executed the request in the buffer. */
+static bool ct_recv_released[CT_RECV_BUFFERS];
+/* The buffers for large requests, their sizes and whether a request is in
+ * one.  Large buffer i has the index CT_RECV_BUFFERS + i. */
+static char *ct_large_buffers[CT_LARGE_BUFFERS];
+static size_t ct_large_sizes[CT_LARGE_BUFFERS];
+static bool ct_large_in_use[CT_LARGE_BUFFERS];
+
+/* Send the request of size bytes given by count elements of type dt at buf to
+ * the communication thread of rank. */
+static int
+ct_send_typed(const void *buf, int count, MPI_Datatype dt, size_t size,
+              int rank)
+{
+  return MPI_Send(buf, count, dt, rank,
+                  size <= CT_RECV_BUFFER_SIZE ? CAF_CT_TAG : CAF_CT_LARGE_TAG,
+                  ct_COMM);
+}
+
+/* Send the request msg of size bytes to the communication thread of rank. */
+static int
+ct_send(const void *msg, size_t size, int rank)
+{
+  return ct_send_typed(msg, size, MPI_BYTE, size, rank);
+}
+
+/* Send size bytes at buf to image dest in CAF_COMM_WORLD with tag.  buf must
+ * not be modified until the reply is complete.  When to_free is not NULL, it
+ * is freed then. */
+static void
+ct_reply(const void *buf, size_t size, int dest, int tag, void *to_free)
+{
+  MPI_Request request;
+  int ierr;
+
+  dprint("ct: Replying %zd bytes to image %d, tag %d.\n", size, dest, tag);
+  ierr = MPI_Isend(buf, size, MPI_BYTE, dest, tag, CAF_COMM_WORLD, &request);
+  chk_err(ierr);
+  pthread_mutex_lock(&ct_replies_lock);
+  if (ct_replies_count == ct_replies_cap)
+  {
+    ct_replies_cap = ct_replies_cap ? 2 * ct_replies_cap : 16;
+    ct_replies
+        = realloc(ct_replies, ct_replies_cap * sizeof(struct ct_reply_t));
+  }
+  ct_replies[ct_replies_count].request = request;
+  ct_replies[ct_replies_count++].to_free = to_free;
+  pthread_mutex_unlock(&ct_replies_lock);
+}
+
+/* Complete the replies that are done, or all of them when wait is set. */
+static void
+ct_replies_progress(bool wait)
+{
+  int i, n, flag, ierr;
+
+  pthread_mutex_lock(&ct_replies_lock);
+  for (i = 0, n = 0; i < ct_replies_count; ++i)
+  {
+    if (wait)
+    {
+      ierr = MPI_Wait(&ct_replies[i].request, MPI_STATUS_IGNORE);
+      flag = 1;
+    }
+    else
+      ierr = MPI_Test(&ct_replies[i].request, &flag, MPI_STATUS_IGNORE);
+    chk_err(ierr);
+    if (flag)
+      free(ct_replies[i].to_free);
+    else
+      ct_replies[n++] = ct_replies[i];
+  }
+  ct_replies_count = n;
+  pthread_mutex_unlock(&ct_replies_lock);
+}
+#endif
+
 #ifdef GCC_GE_15
+/* Register the access with the data at memptr and return its id. */
+static rat_id_t
+running_access_register(void *memptr)
+{
+  struct running_accesses_t *ra;
+  int slot;
+
+  if (running_accesses_nfree > 0)
+    slot = running_accesses_free[--running_accesses_nfree];
+  else if (running_accesses_used < RUNNING_ACCESSES_SLOTS)
+    slot = running_accesses_used++;
+  else
+    caf_runtime_error("more than %d remote accesses are running at once",
+                      RUNNING_ACCESSES_SLOTS);
+  ra = &running_accesses[slot];
+  ra->memptr = memptr;
+  ++ra->generation;
+  __atomic_store_n(&ra->id, ra->generation * RUNNING_ACCESSES_SLOTS + slot,
+                   __ATOMIC_RELEASE);
+  return ra->id;
+}
+
+/* Release the access id after it has completed. */
+static void
+running_access_release(rat_id_t id)
+{
+  const int slot = id % RUNNING_ACCESSES_SLOTS;
+
+  __atomic_store_n(&running_accesses[slot].id, 0, __ATOMIC_RELEASE);
+  running_accesses_free[running_accesses_nfree++] = slot;
+}
+
+/* Return the data of the running access id. */
+static void *
+running_access_memptr(rat_id_t id)
+{
+  struct running_accesses_t *ra
+      = &running_accesses[id % RUNNING_ACCESSES_SLOTS];
+
+  if (id <= 0 || __atomic_load_n(&ra->id, __ATOMIC_ACQUIRE) != id)
+    caf_runtime_error("the remote access %td is not running", id);
+  return ra->memptr;
+}
+
 size_t
 handle_getting(ct_msg_t *msg, int cb_image, void *baseptr, void *dst_ptr,
                void **buffer, int32_t *free_buffer, void *dbase)
@@ -614,7 +1459,9 @@ handle_getting(ct_msg_t *msg, int cb_image, void *baseptr, void *dst_ptr,
   void *src_ptr;
   size_t charlen, send_size;
   int i;
-  mpi_caf_token_t src_token = {(void *)msg->ra_id, MPI_WIN_NULL, NULL};
+  mpi_caf_token_t src_token = {.memptr = (void *)msg->ra_id,
+                               .memptr_win = MPI_WIN_NULL,
+                               .desc = NULL};
 
   if (msg->flags & CT_SRC_HAS_DESC)
   {
@@ -677,31 +1524,6 @@ handle_getting(ct_msg_t *msg, int cb_image, void *baseptr, void *dst_ptr,
         send_size *= ext;
       }
     }
-    if (msg->flags & CT_INCLUDE_DESCRIPTOR)
-    {
-      const size_t desc_size = sizeof_desc_for_rank(
-          GFC_DESCRIPTOR_RANK((gfc_descriptor_t *)dst_ptr));
-      void *tbuff = malloc(desc_size + send_size);
-      dprint("ct: Including dst descriptor: %p, sizeof(desc): %zd, rank: "
-             "%d, sizeof(buffer): %zd, incoming free_buffer: %b.\n",
-             tbuff, desc_size, GFC_DESCRIPTOR_RANK((gfc_descriptor_t *)dst_ptr),
-             send_size, *free_buffer);
-      /* Copy the descriptor contents. */
-      memcpy(tbuff, dst_ptr, desc_size);
-      /* Copy the data to the end of buffer (i.e. behind the descriptor).
-       * Does not copy anything, when send_size is 0.  */
-      memcpy(tbuff + desc_size, *buffer, send_size);
-      if (*free_buffer)
-      {
-        dprint("ct: Freeing buffer: %p.\n", *buffer);
-        free(*buffer);
-      }
-      /* For debugging only: */
-      ((gfc_descriptor_t *)tbuff)->base_addr = tbuff + desc_size;
-      *free_buffer = true;
-      *buffer = tbuff;
-      send_size += desc_size;
-    }
   }
   else
   {
@@ -713,18 +1535,69 @@ handle_getting(ct_msg_t *msg, int cb_image, void *baseptr, void *dst_ptr,
   return send_size;
 }
 
-void
-handle_get_message(ct_msg_t *msg, void *baseptr)
+/* Reply the size bytes of the result at buffer of the get msg with
+ * CT_RESULT_HEADER, see struct ct_result_t.  desc is the destination's
+ * descriptor, when the message has one.  source is the rank of the initiator
+ * in ct_COMM. */
+static void
+ct_reply_result(ct_msg_t *msg, int source, gfc_descriptor_t *desc,
+                void *buffer, size_t size, int32_t free_buffer)
 {
-  int ierr = 0;
-  void *buffer, *dst_ptr, *get_data;
-  size_t send_size;
-  int32_t free_buffer;
+  struct ct_result_t *res = malloc(sizeof(struct ct_result_t));
+  const bool landing = size > CT_LANDING_THRESHOLD;
+  MPI_Aint dest[2];
+  size_t done, n;
+  int ierr = MPI_SUCCESS;
+
+  res->data_size = size;
+  res->desc_size = msg->flags & CT_INCLUDE_DESCRIPTOR
+                       ? sizeof_desc_for_rank(GFC_DESCRIPTOR_RANK(desc))
+                       : 0;
+  res->landing = landing;
+  memcpy(&res->desc, desc, res->desc_size);
+  ct_reply(res, offsetof(struct ct_result_t, desc) + res->desc_size,
+           msg->dest_image, msg->dest_tag, res);
+  if (!landing)
+  {
+    ct_reply(buffer, size, msg->dest_image, msg->dest_tag,
+             free_buffer ? buffer : NULL);
+    return;
+  }
 
-  if (msg->flags & CT_DST_HAS_DESC)
+  ierr = MPI_Recv(dest, 2, MPI_AINT, source, CAF_CT_LANDING_TAG, ct_COMM,
+                  MPI_STATUS_IGNORE);
+  chk_err(ierr);
+  dprint("ct: Putting %zd bytes to address %p of rank %td.\n", size,
+         (void *)dest[0], dest[1]);
+  for (done = 0; ierr == MPI_SUCCESS && done < size; done += n)
   {
-    buffer = msg->data;
-    ((gfc_descriptor_t *)buffer)->base_addr = NULL;
+    n = MIN(size - done, (size_t)INT_MAX);
+    ierr = MPI_Put((char *)buffer + done, n, MPI_BYTE, dest[1], dest[0] + done,
+                   n, MPI_BYTE, ct_landing_win);
+    chk_err(ierr);
+  }
+  if (ierr == MPI_SUCCESS)
+  {
+    ierr = MPI_Win_flush(dest[1], ct_landing_win);
+    chk_err(ierr);
+  }
+  if (free_buffer)
+    free(buffer);
+  ct_reply(&ct_ack[ierr != MPI_SUCCESS], 1, msg->dest_image, msg->dest_tag,
+           NULL);
+}
+
+void
+handle_get_message(ct_msg_t *msg, void *baseptr, int source)
+{
+  void *buffer, *dst_ptr, *get_data;
+  size_t send_size;
+  int32_t free_buffer;
+
+  if (msg->flags & CT_DST_HAS_DESC)
+  {
+    buffer = msg->data;
+    ((gfc_descriptor_t *)buffer)->base_addr = NULL;
     get_data = msg->data
                + sizeof_desc_for_rank(
                    GFC_DESCRIPTOR_RANK((gfc_descriptor_t *)buffer));
@@ -744,25 +1617,21 @@ handle_get_message(ct_msg_t *msg, void *baseptr)
                              &free_buffer, get_data);
 
   dump_mem("ct", buffer, send_size);
-  dprint("ct: Sending %zd bytes to image %d, tag %d.\n", send_size,
-         msg->dest_image, msg->dest_tag);
-  ierr = MPI_Send(buffer, send_size, MPI_BYTE, msg->dest_image, msg->dest_tag,
-                  CAF_COMM_WORLD);
-  chk_err(ierr);
-  if (free_buffer)
-  {
-    dprint("ct: going to free buffer: %p.\n", buffer);
-    free(buffer);
-  }
+  if (msg->flags & CT_RESULT_HEADER)
+    ct_reply_result(msg, source, dst_ptr, buffer, send_size, free_buffer);
+  else
+    ct_reply(buffer, send_size, msg->dest_image, msg->dest_tag,
+             free_buffer ? buffer : NULL);
 }
 
 void
 handle_is_present_message(ct_msg_t *msg, void *baseptr)
 {
-  int ierr = 0;
   void *add_data, *ptr;
-  int32_t result;
-  mpi_caf_token_t src_token = {(void *)msg->ra_id, MPI_WIN_NULL, NULL};
+  int32_t *result = malloc(sizeof(int32_t));
+  mpi_caf_token_t src_token = {.memptr = (void *)msg->ra_id,
+                               .memptr_win = MPI_WIN_NULL,
+                               .desc = NULL};
 
   add_data = msg->data;
   if (msg->flags & CT_SRC_HAS_DESC)
@@ -776,21 +1645,18 @@ handle_is_present_message(ct_msg_t *msg, void *baseptr)
     ptr = baseptr;
 
   accessor_hash_table[msg->accessor_index].u.is_present(
-      add_data, &msg->dest_image, &result, ptr, &src_token, 0);
+      add_data, &msg->dest_image, result, ptr, &src_token, 0);
   dprint("ct: is_present executed.\n");
-  dprint("ct: Sending %d bytes to image %d, tag %d.\n", 1, msg->dest_image,
-         msg->dest_tag);
-  ierr = MPI_Send(&result, 1, MPI_BYTE, msg->dest_image, msg->dest_tag,
-                  CAF_COMM_WORLD);
-  chk_err(ierr);
+  ct_reply(result, 1, msg->dest_image, msg->dest_tag, result);
 }
 
 void
 handle_send_message(ct_msg_t *msg, void *baseptr)
 {
-  int ierr = 0;
   void *src_ptr, *buffer, *dst_ptr, *add_data;
-  mpi_caf_token_t src_token = {(void *)msg->ra_id, MPI_WIN_NULL, NULL};
+  mpi_caf_token_t src_token = {.memptr = (void *)msg->ra_id,
+                               .memptr_win = MPI_WIN_NULL,
+                               .desc = NULL};
 
   dprint("ct: putting data using %d accessor.\n", msg->accessor_index);
   buffer = msg->data;
@@ -851,29 +1717,34 @@ handle_send_message(ct_msg_t *msg, void *baseptr)
       add_data, &msg->dest_image, dst_ptr, src_ptr, &src_token, 0,
       &msg->dest_opt_charlen, &msg->opt_charlen);
   dprint("ct: setter executed.\n");
-  {
-    char c = 0;
-    dprint("ct: Sending %d bytes to image %d, tag %d.\n", 1,
-           msg->dest_image + 1, msg->dest_tag);
-    ierr = MPI_Send(&c, 1, MPI_BYTE, msg->dest_image, msg->dest_tag,
-                    CAF_COMM_WORLD);
-    chk_err(ierr);
-  }
+  ct_reply(&ct_ack[0], 1, msg->dest_image, msg->dest_tag, NULL);
 }
 
+/* The buffer of the thread, in which handle_transfer_message() assembles the
+ * message handled by this image itself.  It is kept for the next one. */
+static __thread void *ct_forward_buffer = NULL;
+static __thread size_t ct_forward_size = 0;
+
+/* Forward the result of the getter of msg, a remote_command_transfer, to the
+ * image receiving it.  The message sent consists of the header of the send
+ * message, the data, the data's descriptor, when CT_TRANSFER_DESC is set, and
+ * the receiver's descriptor and add data.  It is sent from where these pieces
+ * are by a struct datatype of their absolute addresses, so that the data is
+ * not copied. */
 void
 handle_transfer_message(ct_msg_t *msg, void *baseptr)
 {
-  int ierr;
+  int ierr, i, count;
   int32_t free_buffer;
   gfc_max_dim_descriptor_t transfer_desc;
   void *transfer_ptr, *buffer = NULL;
   size_t send_size, src_size, offset;
-  bool free_send_msg;
   ct_msg_t *incoming_send_msg = (ct_msg_t *)msg->data, *send_msg;
   struct transfer_msg_data_t *tmd
       = (struct transfer_msg_data_t *)(incoming_send_msg)->data;
   void *get_msg_data_base = msg->data + tmd->dst_msg_size;
+  const void *piece[4];
+  size_t piece_size[4];
 
   if (msg->flags & CT_TRANSFER_DESC)
   {
@@ -892,95 +1763,179 @@ handle_transfer_message(ct_msg_t *msg, void *baseptr)
       = handle_getting(msg, incoming_send_msg->dest_image, baseptr,
                        transfer_ptr, &buffer, &free_buffer, get_msg_data_base);
 
-  send_size = sizeof(ct_msg_t) + src_size + tmd->dst_desc_size
-              + tmd->dst_add_data_size;
+  /* The data first, then its descriptor. */
+  count = 0;
+  piece[count] = incoming_send_msg;
+  piece_size[count++] = sizeof(ct_msg_t);
+  piece[count] = buffer;
+  piece_size[count++] = src_size;
+  if (msg->flags & CT_TRANSFER_DESC)
+  {
+    incoming_send_msg->transfer_size = src_size;
+    piece[count] = &transfer_desc;
+    piece_size[count++]
+        = sizeof_desc_for_rank(GFC_DESCRIPTOR_RANK(&transfer_desc.base));
+  }
+  piece[count] = tmd->data;
+  piece_size[count++] = tmd->dst_desc_size + tmd->dst_add_data_size;
+  for (i = 0, send_size = 0; i < count; ++i)
+    send_size += piece_size[i];
 
   dprint("ct: src_size: %zd, send_size: %zd, dst_desc_size: %zd, "
          "dst_add_data_size: %zd, buffer: %p.\n",
          src_size, send_size, tmd->dst_desc_size, tmd->dst_add_data_size,
          buffer);
 
-  if ((free_send_msg = ((send_msg = alloca(send_size)) == NULL)))
-  {
-    send_msg = malloc(send_size);
-    if (send_msg == NULL)
-      caf_runtime_error("Unable to allocate memory "
-                        "for internal message in handle_transfer_message().");
-  }
-  memcpy(send_msg, incoming_send_msg, sizeof(ct_msg_t));
-  offset = 0;
-  if (msg->flags & CT_TRANSFER_DESC)
+  if (msg->dest_image != global_this_image && send_size <= INT_MAX)
   {
-    const gfc_descriptor_t *d = (gfc_descriptor_t *)buffer;
-    const int rank = GFC_DESCRIPTOR_RANK(d);
-    const size_t desc_size = sizeof_desc_for_rank(rank),
-                 sz = compute_arr_data_size(d);
-    /* Add the data first.  */
-    send_msg->transfer_size = sz;
-    memcpy(send_msg->data, ((gfc_descriptor_t *)buffer)->base_addr, sz);
-    offset += sz;
-    memcpy(send_msg->data + offset, buffer, desc_size);
-    offset += desc_size;
-  }
-  else
-  {
-    memcpy(send_msg->data, buffer, src_size);
-    offset += src_size;
-  }
-  memcpy(send_msg->data + offset, tmd->data,
-         tmd->dst_desc_size + tmd->dst_add_data_size);
+    int blocklen[4];
+    MPI_Aint disp[4];
+    MPI_Datatype types[4], dt;
 
-  if (msg->dest_image != global_this_image)
-  {
+    for (i = 0; i < count; ++i)
+    {
+      blocklen[i] = piece_size[i];
+      ierr = MPI_Get_address(piece[i], &disp[i]);
+      chk_err(ierr);
+      types[i] = MPI_BYTE;
+    }
+    ierr = MPI_Type_create_struct(count, blocklen, disp, types, &dt);
+    chk_err(ierr);
+    ierr = MPI_Type_commit(&dt);
+    chk_err(ierr);
     dprint("ct: sending message of size %zd to image %d for processing.\n",
            send_size, msg->dest_image);
-    ierr = MPI_Send(send_msg, send_size, MPI_BYTE, msg->dest_image,
-                    msg->dest_tag, ct_COMM);
+    ierr = ct_send_typed(MPI_BOTTOM, 1, dt, send_size, msg->dest_image);
     chk_err(ierr);
+    MPI_Type_free(&dt);
   }
   else
   {
-    int flag;
-    dprint("ct: self handling message of size %zd.\n", send_size);
-    ierr = MPI_Win_get_attr(send_msg->win, MPI_WIN_BASE, &baseptr, &flag);
-    chk_err(ierr);
-    handle_send_message(send_msg, baseptr);
+    /* The receiver needs the message in one piece. */
+    if (send_size > ct_forward_size)
+    {
+      free(ct_forward_buffer);
+      ct_forward_size = send_size;
+      ct_forward_buffer = malloc(send_size);
+      if (ct_forward_buffer == NULL)
+        caf_runtime_error("Unable to allocate memory "
+                          "for internal message in handle_transfer_message().");
+    }
+    send_msg = ct_forward_buffer;
+    for (i = 0, offset = 0; i < count; offset += piece_size[i++])
+      memcpy((char *)send_msg + offset, piece[i], piece_size[i]);
+
+    if (msg->dest_image != global_this_image)
+    {
+      ierr = ct_send(send_msg, send_size, msg->dest_image);
+      chk_err(ierr);
+    }
+    else
+    {
+      int flag;
+      dprint("ct: self handling message of size %zd.\n", send_size);
+      ierr = MPI_Win_get_attr(send_msg->win, MPI_WIN_BASE, &baseptr, &flag);
+      chk_err(ierr);
+      baseptr = (char *)baseptr + send_msg->win_disp;
+      handle_send_message(send_msg, baseptr);
+    }
   }
 
-  if (free_send_msg)
-    free(send_msg);
   if (free_buffer)
   {
     dprint("ct: going to free buffer: %p.\n", buffer);
     free(buffer);
   }
 }
+#endif // GCC_GE_15
+
+#ifdef WITH_COMM_THREAD
+/* Return the committed datatype of the elements of elem_size bytes in a
+ * section of rank dimensions with the given extents and strides in bytes.
+ * The first dimension varies fastest. */
+static MPI_Datatype
+section_bytes_type(size_t elem_size, int rank, const ptrdiff_t *extent,
+                   const ptrdiff_t *stride)
+{
+  MPI_Datatype dt, next;
+  int ierr, j;
+
+  ierr = MPI_Type_contiguous(elem_size, MPI_BYTE, &dt);
+  chk_err(ierr);
+  for (j = 0; j < rank; ++j)
+  {
+    ierr = MPI_Type_create_hvector(extent[j], 1, stride[j], dt, &next);
+    chk_err(ierr);
+    ierr = MPI_Type_free(&dt);
+    chk_err(ierr);
+    dt = next;
+  }
+  ierr = MPI_Type_commit(&dt);
+  chk_err(ierr);
+  return dt;
+}
+
+/* Execute a third party transfer for image initiator, see
+ * sendget_third_party().  Only the main thread uses the pools and pending
+ * puts, therefore the put is issued and flushed here directly. */
+static void
+handle_sendget_message(ct_msg_t *msg, int initiator)
+{
+  struct sendget_msg_data_t *smd = (struct sendget_msg_data_t *)msg->data;
+  const ptrdiff_t *src_dims = smd->dims,
+                  *dst_dims = smd->dims + 2 * smd->src_rank;
+  MPI_Datatype src_dt, dst_dt;
+  int ierr;
+
+  dprint("ct: sendget of %zd byte elements from disp %td to image %d, disp "
+         "%td for image %d.\n",
+         msg->transfer_size, msg->win_disp, msg->dest_image, smd->dst_disp,
+         initiator);
+  src_dt = section_bytes_type(msg->transfer_size, smd->src_rank, src_dims,
+                              src_dims + smd->src_rank);
+  dst_dt = section_bytes_type(msg->transfer_size, smd->dst_rank, dst_dims,
+                              dst_dims + smd->dst_rank);
+  ierr = MPI_Put((char *)symmetric_heap_base + msg->win_disp, 1, src_dt,
+                 msg->dest_image, smd->dst_disp, 1, dst_dt,
+                 symmetric_heap_win);
+  chk_err(ierr);
+  if (ierr == MPI_SUCCESS)
+  {
+    ierr = MPI_Win_flush(msg->dest_image, symmetric_heap_win);
+    chk_err(ierr);
+  }
+  MPI_Type_free(&src_dt);
+  MPI_Type_free(&dst_dt);
+
+  ct_reply(&ct_ack[ierr != MPI_SUCCESS], 1, initiator, msg->dest_tag, NULL);
+}
 
+/* Execute the request msg received from image source. */
 void
-handle_incoming_message(MPI_Status *status_in, MPI_Message *msg_han,
-                        const int cnt)
+handle_incoming_message(ct_msg_t *msg, int source)
 {
+#ifdef GCC_GE_15
   int ierr = 0;
   void *baseptr;
   int flag;
-  ct_msg_t *msg = alloca(cnt);
+#endif
 
-  ierr = MPI_Mrecv(msg, cnt, MPI_BYTE, msg_han, status_in);
-  chk_err(ierr);
-  dprint("ct: Received request of size %d (sizeof(ct_msg) = %zd).\n", cnt,
-         sizeof(ct_msg_t));
+  if (msg->cmd == remote_command_sendget)
+  {
+    handle_sendget_message(msg, source);
+    return;
+  }
 
+#ifdef GCC_GE_15
   if (msg->win != MPI_WIN_NULL)
   {
     ierr = MPI_Win_get_attr(msg->win, MPI_WIN_BASE, &baseptr, &flag);
     chk_err(ierr);
+    baseptr = (char *)baseptr + msg->win_disp;
   }
   else
   {
-    struct running_accesses_t *ra = running_accesses;
-    for (; ra && ra->id != msg->ra_id; ra = ra->next)
-      ;
-    baseptr = ra->memptr;
+    baseptr = running_access_memptr(msg->ra_id);
   }
 
   dprint("ct: Local base for win %d is %p (set: %b) Executing accessor at "
@@ -995,7 +1950,7 @@ handle_incoming_message(MPI_Status *status_in, MPI_Message *msg_han,
   switch (msg->cmd)
   {
     case remote_command_get:
-      handle_get_message(msg, baseptr);
+      handle_get_message(msg, baseptr, source);
       break;
     case remote_command_present:
       handle_is_present_message(msg, baseptr);
@@ -1011,15 +1966,369 @@ handle_incoming_message(MPI_Status *status_in, MPI_Message *msg_han,
                         msg->cmd);
       break;
   }
+#else
+  caf_runtime_error("unknown command %d in message for remote execution",
+                    msg->cmd);
+#endif
+}
+
+/* The communication thread polls for requests and sleeps, up to
+ * CT_POLL_MAX_SLEEP_NS, while there are none.  Blocking in MPI_Mprobe instead
+ * keeps the progress engine of MPI spinning, which starves the one-sided
+ * communication of the image, when both share a core. */
+#define CT_POLL_MAX_SLEEP_NS 100000
+
+/* Sleep for the next step of the back-off of an idle thread. */
+static void
+ct_idle(long *idle_ns)
+{
+  *idle_ns = *idle_ns ? MIN(2 * *idle_ns, CT_POLL_MAX_SLEEP_NS) : 1000;
+  nanosleep(&(struct timespec){0, *idle_ns}, NULL);
+}
+
+/* Post the receives into the buffers. */
+static void
+ct_recv_init(void)
+{
+  int i, ierr;
+
+  for (i = 0; i < CT_RECV_BUFFERS; ++i)
+  {
+    ierr = MPI_Alloc_mem(CT_RECV_BUFFER_SIZE, MPI_INFO_NULL,
+                         &ct_recv_buffers[i]);
+    chk_err(ierr);
+    ierr = MPI_Recv_init(ct_recv_buffers[i], CT_RECV_BUFFER_SIZE, MPI_BYTE,
+                         MPI_ANY_SOURCE, CAF_CT_TAG, ct_COMM,
+                         &ct_recv_requests[i]);
+    chk_err(ierr);
+    ierr = MPI_Start(&ct_recv_requests[i]);
+    chk_err(ierr);
+    ct_recv_released[i] = false;
+  }
+}
+
+/* Return a buffer for a large request of size bytes and set buffer to its
+ * index, or to -1 for memory of its own. */
+static void *
+ct_recv_large_alloc(size_t size, int *buffer)
+{
+  int i, found = -1, ierr;
+  size_t sz;
+  void *mem;
+
+  /* Take the first free buffer fitting the request, else grow the largest
+   * free one. */
+  for (i = 0; i < CT_LARGE_BUFFERS; ++i)
+  {
+    if (__atomic_load_n(&ct_large_in_use[i], __ATOMIC_ACQUIRE))
+      continue;
+    if (found < 0 || ct_large_sizes[i] > ct_large_sizes[found])
+      found = i;
+    if (ct_large_sizes[i] >= size)
+      break;
+  }
+  if (found < 0)
+  {
+    ierr = MPI_Alloc_mem(size, MPI_INFO_NULL, &mem);
+    if (ierr != MPI_SUCCESS)
+      caf_runtime_error("Unable to allocate memory for a request of %zd "
+                        "bytes in communication_thread().",
+                        size);
+    *buffer = -1;
+    return mem;
+  }
+  if (i < CT_LARGE_BUFFERS)
+    found = i;
+  else
+  {
+    for (sz = CT_RECV_BUFFER_SIZE; sz < size; sz <<= 1)
+      ;
+    if (ct_large_buffers[found])
+    {
+      ierr = MPI_Free_mem(ct_large_buffers[found]);
+      chk_err(ierr);
+    }
+    ierr = MPI_Alloc_mem(sz, MPI_INFO_NULL, &ct_large_buffers[found]);
+    if (ierr != MPI_SUCCESS)
+      caf_runtime_error("Unable to allocate memory for a request of %zd "
+                        "bytes in communication_thread().",
+                        size);
+    ct_large_sizes[found] = sz;
+    dprint("ct: Grew large buffer %d to %zd bytes.\n", found, sz);
+  }
+  ct_large_in_use[found] = true;
+  *buffer = CT_RECV_BUFFERS + found;
+  return ct_large_buffers[found];
+}
+
+/* Release the request msg, which is in the receive buffer with index buffer
+ * or, when that is negative, in memory of its own. */
+static void
+ct_recv_release(ct_msg_t *msg, int buffer)
+{
+  int ierr;
+
+  if (buffer < 0)
+  {
+    ierr = MPI_Free_mem(msg);
+    chk_err(ierr);
+  }
+  else if (buffer >= CT_RECV_BUFFERS)
+    __atomic_store_n(&ct_large_in_use[buffer - CT_RECV_BUFFERS], false,
+                     __ATOMIC_RELEASE);
+  else
+    __atomic_store_n(&ct_recv_released[buffer], true, __ATOMIC_RELEASE);
+}
+
+/* Post the receives into the buffers released since the last call.  Only the
+ * communication thread may use the requests. */
+static void
+ct_recv_repost(void)
+{
+  int i, ierr;
+
+  for (i = 0; i < CT_RECV_BUFFERS; ++i)
+    if (__atomic_load_n(&ct_recv_released[i], __ATOMIC_ACQUIRE))
+    {
+      ct_recv_released[i] = false;
+      ierr = MPI_Start(&ct_recv_requests[i]);
+      chk_err(ierr);
+    }
+}
+
+/* Cancel the receives still posted and free the buffers. */
+static void
+ct_recv_finalize(void)
+{
+  int i, flag, ierr;
+
+  ct_recv_repost();
+  for (i = 0; i < CT_RECV_BUFFERS; ++i)
+  {
+    ierr = MPI_Test(&ct_recv_requests[i], &flag, MPI_STATUS_IGNORE);
+    chk_err(ierr);
+    if (!flag)
+    {
+      ierr = MPI_Cancel(&ct_recv_requests[i]);
+      chk_err(ierr);
+      ierr = MPI_Wait(&ct_recv_requests[i], MPI_STATUS_IGNORE);
+      chk_err(ierr);
+    }
+    ierr = MPI_Request_free(&ct_recv_requests[i]);
+    chk_err(ierr);
+    ierr = MPI_Free_mem(ct_recv_buffers[i]);
+    chk_err(ierr);
+  }
+  for (i = 0; i < CT_LARGE_BUFFERS; ++i)
+    if (ct_large_buffers[i])
+    {
+      ierr = MPI_Free_mem(ct_large_buffers[i]);
+      chk_err(ierr);
+      ct_large_buffers[i] = NULL;
+      ct_large_sizes[i] = 0;
+    }
+}
+
+/* The worker pool of the communication thread
+ * With OPENCOARRAYS_CT_WORKERS=n the communication thread only receives the
+ * requests and hands them to n worker threads, which execute them
+ * concurrently.  Thus one slow request does not delay the ones of the other
+ * images.  By default the communication thread executes the requests itself.
+ * The requests are passed through a bounded lock-free queue, which has a
+ * single producer, the communication thread, and many consumers.  Each slot
+ * holds a sequence number telling whether it is free for the position pos
+ * (seq == pos) or holds the request of that position (seq == pos + 1).
+ * Workers finding the queue empty wait on ct_workers_wake, which is signalled
+ * after a push, when ct_workers_idle tells that a worker is waiting. */
+#define CT_QUEUE_SIZE 256
+
+static struct ct_queue_slot_t
+{
+  size_t seq;
+  int source;
+  int buffer;
+  ct_msg_t *msg;
+} ct_queue[CT_QUEUE_SIZE];
+static size_t ct_queue_head = 0, ct_queue_tail = 0;
+static pthread_t *ct_workers = NULL;
+static int ct_num_workers = 0;
+static bool ct_workers_running = false;
+static pthread_mutex_t ct_workers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ct_workers_wake = PTHREAD_COND_INITIALIZER;
+static int ct_workers_idle = 0;
+
+/* Append the request msg of image source received into the receive buffer
+ * with index buffer, see ct_recv_release().  Returns false, when the queue is
+ * full.  Only the communication thread calls this. */
+static bool
+ct_queue_push(ct_msg_t *msg, int source, int buffer)
+{
+  struct ct_queue_slot_t *slot = &ct_queue[ct_queue_head % CT_QUEUE_SIZE];
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ct_queue_head)
+    return false;
+  slot->msg = msg;
+  slot->source = source;
+  slot->buffer = buffer;
+  __atomic_store_n(&slot->seq, ++ct_queue_head, __ATOMIC_RELEASE);
+  /* Pairs with the fence in ct_worker(), so that either the worker sees the
+   * request or this sees the waiting worker. */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ct_workers_idle, __ATOMIC_RELAXED))
+  {
+    pthread_mutex_lock(&ct_workers_lock);
+    pthread_cond_signal(&ct_workers_wake);
+    pthread_mutex_unlock(&ct_workers_lock);
+  }
+  return true;
+}
+
+/* Take the oldest request from the queue.  Returns false, when it is
+ * empty. */
+static bool
+ct_queue_pop(ct_msg_t **msg, int *source, int *buffer)
+{
+  size_t pos = __atomic_load_n(&ct_queue_tail, __ATOMIC_RELAXED);
+
+  for (;;)
+  {
+    struct ct_queue_slot_t *slot = &ct_queue[pos % CT_QUEUE_SIZE];
+    const size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == pos + 1)
+    {
+      if (__atomic_compare_exchange_n(&ct_queue_tail, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      {
+        *msg = slot->msg;
+        *source = slot->source;
+        *buffer = slot->buffer;
+        __atomic_store_n(&slot->seq, pos + CT_QUEUE_SIZE, __ATOMIC_RELEASE);
+        return true;
+      }
+    }
+    else if (seq == pos)
+      return false;
+    else
+      pos = __atomic_load_n(&ct_queue_tail, __ATOMIC_RELAXED);
+  }
+}
+
+/* Return true, when the queue holds no request. */
+static bool
+ct_queue_empty(void)
+{
+  const size_t pos = __atomic_load_n(&ct_queue_tail, __ATOMIC_RELAXED);
+
+  return __atomic_load_n(&ct_queue[pos % CT_QUEUE_SIZE].seq, __ATOMIC_ACQUIRE)
+         != pos + 1;
+}
+
+static void *
+ct_worker(void *)
+{
+  ct_msg_t *msg;
+  int source, buffer;
+  bool running = true;
+
+  while (true)
+  {
+    if (ct_queue_pop(&msg, &source, &buffer))
+    {
+      handle_incoming_message(msg, source);
+      ct_recv_release(msg, buffer);
+      continue;
+    }
+    if (!running)
+      break;
+    pthread_mutex_lock(&ct_workers_lock);
+    __atomic_add_fetch(&ct_workers_idle, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (ct_queue_empty() && ct_workers_running)
+      pthread_cond_wait(&ct_workers_wake, &ct_workers_lock);
+    __atomic_sub_fetch(&ct_workers_idle, 1, __ATOMIC_RELAXED);
+    /* Execute the requests left in the queue before terminating. */
+    running = ct_workers_running;
+    pthread_mutex_unlock(&ct_workers_lock);
+  }
+#ifdef GCC_GE_15
+  free(ct_forward_buffer);
+#endif
+  return NULL;
+}
+
+/* Start the number of workers requested by OPENCOARRAYS_CT_WORKERS. */
+static void
+ct_workers_start(void)
+{
+  const char *envvar = getenv("OPENCOARRAYS_CT_WORKERS");
+  int i, ierr;
+
+  ct_num_workers = envvar != NULL ? atoi(envvar) : 0;
+  if (ct_num_workers <= 0)
+    return;
+  for (i = 0; i < CT_QUEUE_SIZE; ++i)
+    ct_queue[i].seq = i;
+  ct_workers_running = true;
+  ct_workers = malloc(ct_num_workers * sizeof(pthread_t));
+  for (i = 0; i < ct_num_workers; ++i)
+  {
+    ierr = pthread_create(&ct_workers[i], NULL, &ct_worker, NULL);
+    chk_err(ierr);
+  }
+  dprint("ct: Started %d workers.\n", ct_num_workers);
+}
+
+/* Let the workers execute the queued requests and terminate. */
+static void
+ct_workers_stop(void)
+{
+  int i;
+
+  if (ct_num_workers <= 0)
+    return;
+  pthread_mutex_lock(&ct_workers_lock);
+  ct_workers_running = false;
+  pthread_cond_broadcast(&ct_workers_wake);
+  pthread_mutex_unlock(&ct_workers_lock);
+  for (i = 0; i < ct_num_workers; ++i)
+    pthread_join(ct_workers[i], NULL);
+  free(ct_workers);
+  ct_workers = NULL;
+  ct_num_workers = 0;
+}
+
+/* Execute the request msg of image source or queue it for the workers.  See
+ * ct_recv_release() for buffer. */
+static void
+ct_dispatch(ct_msg_t *msg, int source, int buffer, long *idle_ns)
+{
+  if (ct_num_workers > 0)
+  {
+    while (!ct_queue_push(msg, source, buffer))
+    {
+      ct_replies_progress(false);
+      ct_recv_repost();
+      ct_idle(idle_ns);
+    }
+    *idle_ns = 0;
+  }
+  else
+  {
+    handle_incoming_message(msg, source);
+    ct_recv_release(msg, buffer);
+  }
 }
 
 void *
 communication_thread(void *)
 {
-  int ierr = 0, cnt;
+  int ierr = 0, cnt, flag, index;
   MPI_Status status;
   MPI_Message msg_han;
-  void *baseptr;
+  ct_msg_t *msg;
+  long idle_ns = 0;
+  bool terminate = false;
 
 #if defined(__have_pthread_attr_t) && defined(EXTRA_DEBUG_OUTPUT)
   pthread_t self;
@@ -1031,48 +2340,66 @@ communication_thread(void *)
   dprint("ct: Started witch stacksize: %ld.\n", stacksize);
 #endif
 
+  ct_recv_init();
+  ct_workers_start();
   memset(&status, 0, sizeof(MPI_Status));
-  do
+  while (!terminate)
   {
-    dprint("ct: Probing for incoming message.\n");
-    ierr = MPI_Mprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, ct_COMM, &msg_han, &status);
+    ct_replies_progress(false);
+    ct_recv_repost();
+    ierr = MPI_Testany(CT_RECV_BUFFERS, ct_recv_requests, &index, &flag,
+                       &status);
     chk_err(ierr);
-    dprint("ct: Message received from %d, tag %d, mpi-status: %d, processing "
-           "...\n",
-           status.MPI_SOURCE, status.MPI_TAG, status.MPI_ERROR);
-    if (status.MPI_TAG == CAF_CT_TAG && status.MPI_ERROR == MPI_SUCCESS)
+    if (flag && index != MPI_UNDEFINED)
     {
+      idle_ns = 0;
       ierr = MPI_Get_count(&status, MPI_BYTE, &cnt);
       chk_err(ierr);
-
+      dprint("ct: Received request of size %d from %d into buffer %d.\n", cnt,
+             status.MPI_SOURCE, index);
       if (cnt >= sizeof(ct_msg_t))
-      {
-        handle_incoming_message(&status, &msg_han, cnt);
-      }
-      else if (!commthread_running)
-      {
-        /* Pickup empty message. */
-        dprint("ct: Got termination message. Terminating.\n");
-        baseptr = NULL;
-        ierr = MPI_Mrecv(baseptr, cnt, MPI_BYTE, &msg_han, &status);
-        chk_err(ierr);
-      }
+        ct_dispatch((ct_msg_t *)ct_recv_buffers[index], status.MPI_SOURCE,
+                    index, &idle_ns);
       else
       {
-        dprint("ct: Error: message to small, ignoring (got: %d, exp: %zd).\n",
-               cnt, sizeof(ct_msg_t));
+        if (!commthread_running)
+        {
+          dprint("ct: Got termination message. Terminating.\n");
+          terminate = true;
+        }
+        else
+          dprint("ct: Error: message to small, ignoring (got: %d, exp: "
+                 "%zd).\n",
+                 cnt, sizeof(ct_msg_t));
+        ct_recv_release(NULL, index);
       }
+      continue;
     }
-    else if (ierr == MPI_SUCCESS)
+
+    ierr = MPI_Improbe(MPI_ANY_SOURCE, CAF_CT_LARGE_TAG, ct_COMM, &flag,
+                       &msg_han, &status);
+    chk_err(ierr);
+    if (!flag)
     {
-      /* There is a message, but not for us. */
-      dprint("ct: Message not for us received. Setting it free again.\n");
-      // ierr = MPI_Request_free(&msg_han);
-      chk_err(ierr);
+      ct_idle(&idle_ns);
+      continue;
     }
-    else
-      chk_err(ierr);
-  } while (commthread_running);
+    idle_ns = 0;
+    ierr = MPI_Get_count(&status, MPI_BYTE, &cnt);
+    chk_err(ierr);
+    dprint("ct: Receiving large request of size %d from %d.\n", cnt,
+           status.MPI_SOURCE);
+    msg = ct_recv_large_alloc(cnt, &index);
+    ierr = MPI_Mrecv(msg, cnt, MPI_BYTE, &msg_han, &status);
+    chk_err(ierr);
+    ct_dispatch(msg, status.MPI_SOURCE, index, &idle_ns);
+  }
+  ct_workers_stop();
+  ct_replies_progress(true);
+  ct_recv_finalize();
+#ifdef GCC_GE_15
+  free(ct_forward_buffer);
+#endif
   dprint("ct: Ended.\n");
   return NULL;
 }
@@ -1290,6 +2617,7 @@ redo:
     dprint("Comm_compare(*comm, alive_comm, res = %d) = %d.\n", cmpres, ierr);
     if (cmpres == MPI_CONGRUENT)
     {
+      CAF_Win_unlock_all(*stat_tok);
       ierr = MPI_Win_detach(*stat_tok, &img_status);
       chk_err(ierr);
       dprint("detached win img_status.\n");
@@ -1326,6 +2654,7 @@ mutex_lock(MPI_Win win, int image_index, size_t index, int *stat,
 
   if (stat != NULL)
     *stat = 0;
+  pending_accesses_complete();
 
 #ifdef WITH_FAILED_IMAGES
   ierr = MPI_Test(&alive_request, &flag, MPI_STATUS_IGNORE);
@@ -1343,6 +2672,7 @@ mutex_lock(MPI_Win win, int image_index, size_t index, int *stat,
       *acquired_lock = 1;
     else
       *acquired_lock = 0;
+    shared_memory_fence();
     return;
   }
 
@@ -1375,6 +2705,8 @@ mutex_lock(MPI_Win win, int image_index, size_t index, int *stat,
     usleep(caf_this_image * i);
 #endif
   }
+  /* The accesses after the lock must not be done before acquiring it. */
+  shared_memory_fence();
 
   if (stat)
     *stat = ierr;
@@ -1416,6 +2748,7 @@ mutex_unlock(MPI_Win win, int image_index, size_t index, int *stat,
   chk_err(ierr);
 #endif
 
+  pending_accesses_complete();
   CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image_index - 1, win);
   ierr = MPI_Fetch_and_op(&newval, &value, MPI_INT, image_index - 1,
                           index * sizeof(int), MPI_REPLACE, win);
@@ -1450,18 +2783,1225 @@ stat_error:
 #endif // MPI_VERSION
 }
 
-/* Initialize coarray program.  This routine assumes that no other
- * MPI initialization happened before. */
-
-void
-PREFIX(init)(int *argc, char ***argv)
+#ifdef GCC_GE_7
+/* Get the size of the symmetric heap requested by the user. */
+static size_t
+symmetric_heap_requested_size(void)
 {
-  int flag;
-  if (caf_num_images == 0)
-  {
-    /* Flag rc as unused, because conditional compilation.  */
-    int ierr = 0, i = 0, j = 0, rc __attribute__((unused)), prov_lev = 0;
-    int is_init = 0, prior_thread_level = MPI_THREAD_MULTIPLE;
+  const char *envvar = getenv("OPENCOARRAYS_SYMMETRIC_HEAP_SIZE");
+  char *end;
+  size_t sz;
+
+  if (envvar == NULL || *envvar == '\0')
+    return SYMMETRIC_HEAP_DEFAULT_SIZE;
+
+  sz = strtoull(envvar, &end, 10);
+  switch (*end)
+  {
+    case 'g':
+    case 'G':
+      sz <<= 10;
+      /* Intentionally fall through. */
+    case 'm':
+    case 'M':
+      sz <<= 10;
+      /* Intentionally fall through. */
+    case 'k':
+    case 'K':
+      sz <<= 10;
+      break;
+    default:
+      break;
+  }
+  return sz;
+}
+
+/* Record the addresses of the heaps of the images on this node. */
+static void
+symmetric_heap_map_peers(void)
+{
+  MPI_Group shm_group, world_group;
+  int ierr, shm_size, r, world_rank, disp_unit;
+  MPI_Aint peer_size;
+  void *peer_base;
+
+  ierr = MPI_Win_get_group(symmetric_heap_shm_win, &shm_group);
+  chk_err(ierr);
+  ierr = MPI_Comm_group(CAF_COMM_WORLD, &world_group);
+  chk_err(ierr);
+  ierr = MPI_Group_size(shm_group, &shm_size);
+  chk_err(ierr);
+
+  symmetric_heap_peers = calloc(caf_num_images, sizeof(char *));
+  for (r = 0; r < shm_size; ++r)
+  {
+    ierr = MPI_Win_shared_query(symmetric_heap_shm_win, r, &peer_size,
+                                &disp_unit, &peer_base);
+    chk_err(ierr);
+    ierr = MPI_Group_translate_ranks(shm_group, 1, &r, world_group,
+                                     &world_rank);
+    chk_err(ierr);
+    symmetric_heap_peers[world_rank] = peer_base;
+  }
+
+  ierr = MPI_Group_free(&shm_group);
+  chk_err(ierr);
+  ierr = MPI_Group_free(&world_group);
+  chk_err(ierr);
+}
+
+/* Allocate the window of the symmetric heap.  Collective on CAF_COMM_WORLD. */
+static void
+symmetric_heap_init(void)
+{
+#if MPI_VERSION >= 3
+  const char *envvar = getenv("OPENCOARRAYS_SHARED_MEMORY");
+  unsigned long long params[2]
+      = {symmetric_heap_requested_size(),
+         envvar == NULL || *envvar == '\0' || atoi(envvar) != 0};
+  unsigned long long sz;
+  int ierr;
+
+  /* The offsets computed on the heap are only the same on all images, when
+   * the heap's size is.  Therefore take the one of the first image. */
+  ierr = MPI_Bcast(params, 2, MPI_UNSIGNED_LONG_LONG, 0, CAF_COMM_WORLD);
+  chk_err(ierr);
+  sz = params[0] & ~(unsigned long long)(SYMMETRIC_HEAP_ALIGN - 1);
+  if (sz == 0)
+    return;
+
+  if (params[1])
+  {
+    MPI_Info info;
+    int node_size;
+
+    ierr = MPI_Comm_split_type(CAF_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+                               MPI_INFO_NULL, &caf_node_comm);
+    chk_err(ierr);
+    ierr = MPI_Comm_size(caf_node_comm, &node_size);
+    chk_err(ierr);
+
+    /* Let each image's part of the heap be placed close to it. */
+    ierr = MPI_Info_dup(mpi_info_same_size, &info);
+    chk_err(ierr);
+    ierr = MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    chk_err(ierr);
+    if (node_size == caf_num_images)
+    {
+      /* All images are on this node, the shared window serves for the
+       * one-sided communication, too. */
+      ierr = MPI_Win_allocate_shared(sz, 1, info, CAF_COMM_WORLD,
+                                     &symmetric_heap_base,
+                                     &symmetric_heap_shm_win);
+      chk_err(ierr);
+      symmetric_heap_win = symmetric_heap_shm_win;
+    }
+    else
+    {
+      ierr = MPI_Win_allocate_shared(sz, 1, info, caf_node_comm,
+                                     &symmetric_heap_base,
+                                     &symmetric_heap_shm_win);
+      chk_err(ierr);
+      ierr = MPI_Win_create(symmetric_heap_base, sz, 1, mpi_info_same_size,
+                            CAF_COMM_WORLD, &symmetric_heap_win);
+      chk_err(ierr);
+    }
+    ierr = MPI_Info_free(&info);
+    chk_err(ierr);
+    symmetric_heap_map_peers();
+  }
+  else
+  {
+    ierr = MPI_Win_allocate(sz, 1, mpi_info_same_size, CAF_COMM_WORLD,
+                            &symmetric_heap_base, &symmetric_heap_win);
+    chk_err(ierr);
+  }
+  CAF_Win_lock_all(symmetric_heap_win);
+
+  symmetric_heap_free = malloc(sizeof(struct symmetric_heap_extent_t));
+  symmetric_heap_free->offset = 0;
+  symmetric_heap_free->size = sz;
+  symmetric_heap_free->next = NULL;
+  dprint("Symmetric heap of %llu bytes at %p, win: %d.\n", sz,
+         symmetric_heap_base, symmetric_heap_win);
+#endif // MPI_VERSION
+}
+
+/* Free the window of the symmetric heap.  Collective on the initial team. */
+static void
+symmetric_heap_finalize(void)
+{
+  struct symmetric_heap_extent_t *cur = symmetric_heap_free, *next;
+  int ierr;
+
+  for (; cur; cur = next)
+  {
+    next = cur->next;
+    free(cur);
+  }
+  symmetric_heap_free = NULL;
+
+  if (symmetric_heap_win != MPI_WIN_NULL)
+  {
+    CAF_Win_unlock_all(symmetric_heap_win);
+    if (symmetric_heap_shm_win == symmetric_heap_win)
+      symmetric_heap_shm_win = MPI_WIN_NULL;
+    ierr = MPI_Win_free(&symmetric_heap_win);
+    chk_err(ierr);
+    symmetric_heap_base = NULL;
+  }
+  /* The memory of the shared window has to outlive the heap's window. */
+  if (symmetric_heap_shm_win != MPI_WIN_NULL)
+  {
+    ierr = MPI_Win_free(&symmetric_heap_shm_win);
+    chk_err(ierr);
+  }
+  if (caf_node_comm != MPI_COMM_NULL)
+  {
+    ierr = MPI_Comm_free(&caf_node_comm);
+    chk_err(ierr);
+  }
+  free(symmetric_heap_peers);
+  symmetric_heap_peers = NULL;
+}
+
+/* Reserve size bytes on the symmetric heap for the token.  Returns false, when
+ * no extent is large enough.  Only to be called collectively in the initial
+ * team. */
+static bool
+symmetric_heap_alloc(mpi_caf_token_t *token, size_t size)
+{
+  struct symmetric_heap_extent_t *cur = symmetric_heap_free, *prev = NULL;
+
+  size = (size + SYMMETRIC_HEAP_ALIGN - 1) & ~(SYMMETRIC_HEAP_ALIGN - 1);
+  if (size == 0)
+    size = SYMMETRIC_HEAP_ALIGN;
+
+  for (; cur && cur->size < size; prev = cur, cur = cur->next)
+    ;
+  if (cur == NULL)
+    return false;
+
+  token->memptr_win = symmetric_heap_win;
+  token->memptr_disp = cur->offset;
+  token->memptr_size = size;
+  token->memptr_peers = symmetric_heap_peers;
+  token->memptr = (char *)symmetric_heap_base + cur->offset;
+
+  cur->offset += size;
+  cur->size -= size;
+  if (cur->size == 0)
+  {
+    if (prev)
+      prev->next = cur->next;
+    else
+      symmetric_heap_free = cur->next;
+    free(cur);
+  }
+  return true;
+}
+
+/* Return the memory of the token to the symmetric heap merging it with
+ * adjacent free extents. */
+static void
+symmetric_heap_release(mpi_caf_token_t *token)
+{
+  struct symmetric_heap_extent_t *cur = symmetric_heap_free, *prev = NULL,
+                                 *ext;
+  const MPI_Aint offset = token->memptr_disp;
+  const size_t size = token->memptr_size;
+
+  for (; cur && cur->offset < offset; prev = cur, cur = cur->next)
+    ;
+
+  if (prev && prev->offset + (MPI_Aint)prev->size == offset)
+  {
+    prev->size += size;
+    ext = prev;
+  }
+  else
+  {
+    ext = malloc(sizeof(struct symmetric_heap_extent_t));
+    ext->offset = offset;
+    ext->size = size;
+    ext->next = cur;
+    if (prev)
+      prev->next = ext;
+    else
+      symmetric_heap_free = ext;
+  }
+  if (cur && ext->offset + (MPI_Aint)ext->size == cur->offset)
+  {
+    ext->size += cur->size;
+    ext->next = cur->next;
+    free(cur);
+  }
+
+  token->memptr_win = MPI_WIN_NULL;
+  token->memptr_peers = NULL;
+  token->memptr = NULL;
+}
+
+/* Return the size class of a block of size bytes in the pool of
+ * global_dynamic_win or -1, when the block is too large for the pool. */
+static int
+dynamic_pool_class(size_t size)
+{
+  int cls = 0;
+  size_t block = DYNAMIC_POOL_MIN_BLOCK;
+
+  if (size > DYNAMIC_POOL_MAX_BLOCK)
+    return -1;
+  for (; block < size; block <<= 1)
+    ++cls;
+  return cls;
+}
+
+/* Get size bytes of memory, that is attached to global_dynamic_win.  The
+ * caller has to make sure, that no access epoch is active on the window. */
+static void *
+dynamic_pool_alloc(size_t size)
+{
+  const int cls = dynamic_pool_class(size);
+  void *mem;
+  int ierr;
+
+  if (cls < 0)
+  {
+    ierr = MPI_Alloc_mem(size, MPI_INFO_NULL, &mem);
+    chk_err(ierr);
+    ierr = MPI_Win_attach(global_dynamic_win, mem, size);
+    chk_err(ierr);
+    return mem;
+  }
+
+  if (dynamic_pool_free[cls] == NULL)
+  {
+    const size_t block = DYNAMIC_POOL_MIN_BLOCK << cls;
+    struct dynamic_pool_slab_t *slab
+        = malloc(sizeof(struct dynamic_pool_slab_t));
+    size_t i;
+
+    ierr = MPI_Alloc_mem(DYNAMIC_POOL_SLAB_SIZE, MPI_INFO_NULL, &slab->mem);
+    chk_err(ierr);
+    ierr = MPI_Win_attach(global_dynamic_win, slab->mem,
+                          DYNAMIC_POOL_SLAB_SIZE);
+    chk_err(ierr);
+    slab->next = dynamic_pool_slabs;
+    dynamic_pool_slabs = slab;
+    dprint("Attached slab %p for blocks of %zd bytes to global_dynamic_win.\n",
+           slab->mem, block);
+
+    /* Link the blocks back to front to hand them out in address order. */
+    for (i = DYNAMIC_POOL_SLAB_SIZE / block; i > 0; --i)
+    {
+      void **cur = (void **)((char *)slab->mem + (i - 1) * block);
+      *cur = dynamic_pool_free[cls];
+      dynamic_pool_free[cls] = cur;
+    }
+  }
+
+  mem = dynamic_pool_free[cls];
+  dynamic_pool_free[cls] = *(void **)mem;
+  return mem;
+}
+
+/* Return memory obtained from dynamic_pool_alloc () for size bytes. */
+static void
+dynamic_pool_release(void *mem, size_t size)
+{
+  const int cls = dynamic_pool_class(size);
+  int ierr;
+
+  if (cls < 0)
+  {
+    ierr = MPI_Win_detach(global_dynamic_win, mem);
+    chk_err(ierr);
+    ierr = MPI_Free_mem(mem);
+    chk_err(ierr);
+    return;
+  }
+
+  *(void **)mem = dynamic_pool_free[cls];
+  dynamic_pool_free[cls] = mem;
+}
+
+/* Detach and free all slabs of the pool. */
+static void
+dynamic_pool_finalize()
+{
+  struct dynamic_pool_slab_t *slab = dynamic_pool_slabs, *next;
+  int ierr;
+
+  for (; slab; slab = next)
+  {
+    next = slab->next;
+    ierr = MPI_Win_detach(global_dynamic_win, slab->mem);
+    chk_err(ierr);
+    ierr = MPI_Free_mem(slab->mem);
+    chk_err(ierr);
+    free(slab);
+  }
+  dynamic_pool_slabs = NULL;
+  memset(dynamic_pool_free, 0, sizeof(dynamic_pool_free));
+}
+#endif // GCC_GE_7
+
+/* Get a staging buffer of at least size bytes from the pool.  Return it with
+ * bounce_release(). */
+static void *
+bounce_alloc(size_t size)
+{
+  union bounce_buffer_t *buf;
+  size_t block = BOUNCE_POOL_MIN_BLOCK;
+  int cls = 0, ierr;
+
+  if (size > BOUNCE_POOL_MAX_BLOCK)
+  {
+    cls = BOUNCE_POOL_NUM_CLASSES;
+    block = size;
+  }
+  else
+    for (; block < size; block <<= 1)
+      ++cls;
+  if (cls < BOUNCE_POOL_NUM_CLASSES && (buf = bounce_pool_free[cls]) != NULL)
+  {
+    bounce_pool_free[cls] = buf->h.next;
+    return buf + 1;
+  }
+
+  ierr = MPI_Alloc_mem(sizeof(union bounce_buffer_t) + block, MPI_INFO_NULL,
+                       &buf);
+  if (ierr != MPI_SUCCESS)
+    caf_runtime_error("Unable to allocate %zd bytes for an internal buffer.",
+                      size);
+  dprint("Allocated staging buffer %p of %zd bytes.\n", buf + 1, block);
+  buf->h.cls = cls;
+  return buf + 1;
+}
+
+/* Return a buffer obtained from bounce_alloc() to the pool. */
+static void
+bounce_release(void *mem)
+{
+  union bounce_buffer_t *buf = (union bounce_buffer_t *)mem - 1;
+  int ierr;
+
+  if (buf->h.cls == BOUNCE_POOL_NUM_CLASSES)
+  {
+    ierr = MPI_Free_mem(buf);
+    chk_err(ierr);
+    return;
+  }
+  buf->h.next = bounce_pool_free[buf->h.cls];
+  bounce_pool_free[buf->h.cls] = buf;
+}
+
+/* Free all buffers of the pool. */
+static void
+bounce_pool_finalize()
+{
+  union bounce_buffer_t *buf, *next;
+  int cls, ierr;
+
+  for (cls = 0; cls < BOUNCE_POOL_NUM_CLASSES; ++cls)
+  {
+    for (buf = bounce_pool_free[cls]; buf; buf = next)
+    {
+      next = buf->h.next;
+      ierr = MPI_Free_mem(buf);
+      chk_err(ierr);
+    }
+    bounce_pool_free[cls] = NULL;
+  }
+}
+
+/* Return the index of the first slot to probe for token. */
+static size_t
+token_registry_hash(const struct caf_token_registry_t *reg, const void *token)
+{
+  uint64_t h = (uint64_t)(uintptr_t)token * 0x9E3779B97F4A7C15ULL;
+  return (size_t)(h ^ (h >> 32)) & (reg->capacity - 1);
+}
+
+/* Return the slot holding the entry of token or NULL, when the token is not
+ * registered. */
+static struct caf_token_entry_t **
+token_registry_lookup(struct caf_token_registry_t *reg, const void *token)
+{
+  size_t i;
+
+  if (reg->capacity == 0)
+    return NULL;
+
+  for (i = token_registry_hash(reg, token); reg->slots[i] != NULL;
+       i = (i + 1) & (reg->capacity - 1))
+    if (reg->slots[i] != &token_registry_removed
+        && reg->slots[i]->token == token)
+      return &reg->slots[i];
+  return NULL;
+}
+
+/* Put the entry into the first free slot of the hash table. */
+static void
+token_registry_insert(struct caf_token_registry_t *reg,
+                      struct caf_token_entry_t *entry)
+{
+  size_t i = token_registry_hash(reg, entry->token);
+
+  for (; reg->slots[i] != NULL && reg->slots[i] != &token_registry_removed;
+       i = (i + 1) & (reg->capacity - 1))
+    ;
+  if (reg->slots[i] == NULL)
+    ++reg->used;
+  reg->slots[i] = entry;
+}
+
+/* Rebuild the hash table from the list of entries, growing it when it would
+ * be more than half full. */
+static void
+token_registry_rehash(struct caf_token_registry_t *reg)
+{
+  struct caf_token_entry_t *cur;
+  size_t capacity = reg->capacity ? reg->capacity : 64;
+
+  while ((reg->count + 1) * 2 > capacity)
+    capacity *= 2;
+
+  free(reg->slots);
+  reg->slots = calloc(capacity, sizeof(struct caf_token_entry_t *));
+  if (reg->slots == NULL)
+    caf_internal_error("Out of memory in the token registry", NULL, NULL, 0);
+  reg->capacity = capacity;
+  reg->used = 0;
+  for (cur = reg->first; cur; cur = cur->next)
+    token_registry_insert(reg, cur);
+}
+
+/* Return the index in reg->by_mem of the first entry whose memory starts
+ * above mem. */
+static size_t
+token_registry_mem_index(const struct caf_token_registry_t *reg,
+                         const void *mem)
+{
+  size_t lo = 0, hi = reg->by_mem_count, mid;
+
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if ((const char *)reg->by_mem[mid]->mem <= (const char *)mem)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Insert entry into reg->by_mem, when it holds memory. */
+static void
+token_registry_mem_insert(struct caf_token_registry_t *reg,
+                          struct caf_token_entry_t *entry)
+{
+  size_t i;
+
+  if (entry->mem == NULL || entry->size == 0)
+    return;
+  if (reg->by_mem_count == reg->by_mem_capacity)
+  {
+    reg->by_mem_capacity = reg->by_mem_capacity ? 2 * reg->by_mem_capacity
+                                                : 64;
+    reg->by_mem = realloc(reg->by_mem,
+                          reg->by_mem_capacity * sizeof(*reg->by_mem));
+    if (reg->by_mem == NULL)
+      caf_internal_error("Out of memory in the token registry", NULL, NULL, 0);
+  }
+  i = token_registry_mem_index(reg, entry->mem);
+  memmove(&reg->by_mem[i + 1], &reg->by_mem[i],
+          (reg->by_mem_count - i) * sizeof(struct caf_token_entry_t *));
+  reg->by_mem[i] = entry;
+  ++reg->by_mem_count;
+}
+
+/* Remove entry from reg->by_mem, when it is in it. */
+static void
+token_registry_mem_remove(struct caf_token_registry_t *reg,
+                          struct caf_token_entry_t *entry)
+{
+  size_t i;
+
+  if (entry->mem == NULL || entry->size == 0)
+    return;
+  /* Entries with memory never overlap, hence the one before the first
+   * starting above entry->mem is entry. */
+  i = token_registry_mem_index(reg, entry->mem) - 1;
+  memmove(&reg->by_mem[i], &reg->by_mem[i + 1],
+          (reg->by_mem_count - i - 1) * sizeof(struct caf_token_entry_t *));
+  --reg->by_mem_count;
+}
+
+/* Return the entry whose memory contains the size bytes at mem or NULL. */
+static struct caf_token_entry_t *
+token_registry_find_mem(const struct caf_token_registry_t *reg,
+                        const void *mem, size_t size)
+{
+  size_t i = token_registry_mem_index(reg, mem);
+  struct caf_token_entry_t *entry;
+
+  if (i == 0)
+    return NULL;
+  entry = reg->by_mem[i - 1];
+  return ((const char *)mem + size <= (const char *)entry->mem + entry->size)
+             ? entry
+             : NULL;
+}
+
+/* Register token holding the size bytes of memory at mem. */
+static void
+token_registry_add(struct caf_token_registry_t *reg, void *token, void *mem,
+                   size_t size)
+{
+  struct caf_token_entry_t *entry = malloc(sizeof(struct caf_token_entry_t));
+
+  /* Keep at most three quarter of the slots in use for short probe chains.
+   * The table is rebuilt before the entry is linked into the list, which
+   * would insert it a second time. */
+  if ((reg->used + 1) * 4 > reg->capacity * 3)
+    token_registry_rehash(reg);
+
+  entry->token = token;
+  entry->mem = mem;
+  entry->size = size;
+  entry->prev = reg->last;
+  entry->next = NULL;
+  if (reg->last)
+    reg->last->next = entry;
+  else
+    reg->first = entry;
+  reg->last = entry;
+  ++reg->count;
+  reg->bytes += size;
+  token_registry_insert(reg, entry);
+  token_registry_mem_insert(reg, entry);
+}
+
+/* Update the memory held by the token of entry to the size bytes at mem. */
+static void
+token_registry_resize(struct caf_token_registry_t *reg,
+                      struct caf_token_entry_t *entry, void *mem, size_t size)
+{
+  token_registry_mem_remove(reg, entry);
+  reg->bytes = reg->bytes - entry->size + size;
+  entry->mem = mem;
+  entry->size = size;
+  token_registry_mem_insert(reg, entry);
+}
+
+/* Remove the entry in slot from the registry. */
+static void
+token_registry_remove(struct caf_token_registry_t *reg,
+                      struct caf_token_entry_t **slot)
+{
+  struct caf_token_entry_t *entry = *slot;
+
+  *slot = &token_registry_removed;
+  token_registry_mem_remove(reg, entry);
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    reg->first = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    reg->last = entry->prev;
+  --reg->count;
+  reg->bytes -= entry->size;
+  free(entry);
+}
+
+/* Remove all entries from the registry.  The tokens are not touched. */
+static void
+token_registry_clear(struct caf_token_registry_t *reg)
+{
+  struct caf_token_entry_t *cur = reg->first, *next;
+
+  for (; cur; cur = next)
+  {
+    next = cur->next;
+    free(cur);
+  }
+  free(reg->slots);
+  free(reg->by_mem);
+  memset(reg, 0, sizeof(struct caf_token_registry_t));
+}
+
+/* Compute the table of the ranks in win of the images indexed by their rank
+ * in the initial team.  Images not in the window's group are mapped to
+ * MPI_UNDEFINED.  Returns NULL, when the group of win is the initial team. */
+static int *
+win_ranks_create(MPI_Win win)
+{
+  MPI_Group win_group;
+  int ierr, cmp, n, i, *initial_ranks, *win_ranks = NULL;
+
+  ierr = MPI_Win_get_group(win, &win_group);
+  chk_err(ierr);
+  ierr = MPI_Group_compare(caf_initial_group, win_group, &cmp);
+  chk_err(ierr);
+  if (cmp != MPI_IDENT)
+  {
+    ierr = MPI_Group_size(caf_initial_group, &n);
+    chk_err(ierr);
+    initial_ranks = malloc(n * sizeof(int));
+    win_ranks = malloc(n * sizeof(int));
+    for (i = 0; i < n; ++i)
+      initial_ranks[i] = i;
+    ierr = MPI_Group_translate_ranks(caf_initial_group, n, initial_ranks,
+                                     win_group, win_ranks);
+    chk_err(ierr);
+    free(initial_ranks);
+  }
+  ierr = MPI_Group_free(&win_group);
+  chk_err(ierr);
+  return win_ranks;
+}
+
+/* Recompute caf_team_ranks after the current team changed. */
+static void
+team_ranks_update(void)
+{
+  MPI_Group team_group;
+  int ierr, i, *ranks;
+
+  free(caf_team_ranks);
+  caf_team_ranks = NULL;
+  if (used_teams->prev == NULL)
+    return;
+
+  ierr = MPI_Comm_group(CAF_COMM_WORLD, &team_group);
+  chk_err(ierr);
+  ranks = malloc(caf_num_images * sizeof(int));
+  caf_team_ranks = malloc(caf_num_images * sizeof(int));
+  for (i = 0; i < caf_num_images; ++i)
+    ranks[i] = i;
+  ierr = MPI_Group_translate_ranks(team_group, caf_num_images, ranks,
+                                   caf_initial_group, caf_team_ranks);
+  chk_err(ierr);
+  free(ranks);
+  ierr = MPI_Group_free(&team_group);
+  chk_err(ierr);
+}
+
+/* Translate the rank of an image in the current team into its rank in the
+ * window with the rank table win_ranks. */
+static inline int
+win_rank(const int *win_ranks, int rank)
+{
+  if (caf_team_ranks)
+    rank = caf_team_ranks[rank];
+  return win_ranks ? win_ranks[rank] : rank;
+}
+
+/* Return the address of displacement disp in the memory of the window of
+ * token on rank of the window's group, when this image can access it directly
+ * through shared memory, else NULL. */
+static inline void *
+shared_memory_address(caf_token_t token, int rank, MPI_Aint disp)
+{
+#ifdef GCC_GE_7
+  char **peers = token ? ((mpi_caf_token_t *)token)->memptr_peers : NULL;
+
+  if (peers && peers[rank])
+    return peers[rank] + disp;
+#endif
+  return NULL;
+}
+
+/* Return the address of displacement disp of win on rank, when this image can
+ * access it with loads and stores, i.e., when rank is this image or the
+ * memory is node-local, else NULL.  Token is the one win belongs to or NULL
+ * for global_dynamic_win, whose displacements are addresses. */
+static inline void *
+local_address(caf_token_t token, MPI_Win win, int rank, MPI_Aint disp)
+{
+  void *addr;
+
+  if (win == global_dynamic_win)
+    return (rank == global_this_image) ? (void *)disp : NULL;
+  if ((addr = shared_memory_address(token, rank, disp)))
+    return addr;
+#ifdef GCC_GE_7
+  if (token)
+  {
+    mpi_caf_token_t *mpi_token = (mpi_caf_token_t *)token;
+    if (mpi_token->memptr
+        && rank == win_rank(mpi_token->memptr_win_ranks, caf_this_image - 1))
+      return (char *)mpi_token->memptr + (disp - mpi_token->memptr_disp);
+  }
+#endif
+  return NULL;
+}
+
+/* Large transfers are split into chunks of at most caf_transfer_chunk bytes,
+ * which keeps the counts passed to MPI within an int and lets the conversion
+ * of one chunk overlap with the transfer of another.  The size is set by
+ * OPENCOARRAYS_TRANSFER_CHUNK_SIZE, 0 until read. */
+#define TRANSFER_CHUNK_DEFAULT_SIZE ((size_t)4 << 20)
+static size_t caf_transfer_chunk = 0;
+
+/* Return the size in bytes of the chunks of large transfers. */
+static size_t
+transfer_chunk_size(void)
+{
+  if (caf_transfer_chunk == 0)
+  {
+    const char *envvar = getenv("OPENCOARRAYS_TRANSFER_CHUNK_SIZE");
+    long long sz = envvar != NULL ? atoll(envvar) : 0;
+
+    caf_transfer_chunk = sz > 0 ? (size_t)sz : TRANSFER_CHUNK_DEFAULT_SIZE;
+    if (caf_transfer_chunk > INT_MAX)
+      caf_transfer_chunk = INT_MAX;
+  }
+  return caf_transfer_chunk;
+}
+
+#ifdef GCC_GE_7
+/* The read cache
+ * Between PREFIX(co_cache_begin) and PREFIX(co_cache_end) the data of a
+ * coarray read from another image is kept in blocks of READ_CACHE_BLOCK bytes.
+ * A conforming program does not modify data in the segment in which another
+ * image reads it, therefore the cached blocks stay valid until the next image
+ * control statement, i.e., while caf_segment does not change.  Writes of this
+ * image to a coarray drop its blocks.  At most READ_CACHE_MAX_BYTES are kept;
+ * the least recently used entries are evicted first. */
+#define READ_CACHE_BLOCK ((MPI_Aint)4096)
+static const size_t READ_CACHE_MAX_BYTES = (size_t)1 << 20;
+
+struct read_cache_entry_t
+{
+  mpi_caf_token_t *token;
+  int rank;
+  /* The displacements [lo, hi) in the token's window held in data. */
+  MPI_Aint lo, hi;
+  struct read_cache_entry_t *next;
+  char data[];
+};
+
+/* The entries, most recently used first. */
+static struct read_cache_entry_t *read_cache = NULL;
+static size_t read_cache_bytes = 0;
+static unsigned long read_cache_segment = 0;
+
+/* Drop the cached data of token or of all tokens, when token is NULL. */
+static void
+read_cache_drop(mpi_caf_token_t *token)
+{
+  struct read_cache_entry_t **pe = &read_cache, *e;
+
+  while ((e = *pe))
+  {
+    if (token == NULL || e->token == token)
+    {
+      *pe = e->next;
+      read_cache_bytes -= e->hi - e->lo;
+      free(e);
+    }
+    else
+      pe = &e->next;
+  }
+}
+
+/* Return the address of the cached copy of the size bytes at displacement disp
+ * of token's window on rank, reading the blocks holding them on a miss, or
+ * NULL, when the token's data is not cached. */
+static const char *
+read_cache_lookup(mpi_caf_token_t *token, int rank, MPI_Aint disp, size_t size)
+{
+  struct read_cache_entry_t **pe, *e;
+  const MPI_Aint base = token->memptr_disp;
+  MPI_Aint lo, hi;
+  int ierr;
+
+  if (read_cache_segment != caf_segment)
+  {
+    read_cache_drop(NULL);
+    read_cache_segment = caf_segment;
+  }
+  for (pe = &read_cache; (e = *pe); pe = &e->next)
+    if (e->token == token && e->rank == rank && e->lo <= disp
+        && disp + (MPI_Aint)size <= e->hi)
+    {
+      *pe = e->next;
+      e->next = read_cache;
+      read_cache = e;
+      return e->data + (disp - e->lo);
+    }
+
+  lo = base + (disp - base) / READ_CACHE_BLOCK * READ_CACHE_BLOCK;
+  hi = base + (disp - base + size + READ_CACHE_BLOCK - 1) / READ_CACHE_BLOCK
+                  * READ_CACHE_BLOCK;
+  hi = MIN(hi, base + (MPI_Aint)token->cached_size);
+  if (disp + (MPI_Aint)size > hi || (size_t)(hi - lo) > READ_CACHE_MAX_BYTES)
+    return NULL;
+  while (read_cache_bytes + (hi - lo) > READ_CACHE_MAX_BYTES)
+  {
+    for (pe = &read_cache; (*pe)->next; pe = &(*pe)->next)
+      ;
+    read_cache_bytes -= (*pe)->hi - (*pe)->lo;
+    free(*pe);
+    *pe = NULL;
+  }
+
+  e = malloc(sizeof(struct read_cache_entry_t) + (hi - lo));
+  e->token = token;
+  e->rank = rank;
+  e->lo = lo;
+  e->hi = hi;
+  CAF_Win_lock(MPI_LOCK_SHARED, rank, token->memptr_win);
+  ierr = MPI_Get(e->data, hi - lo, MPI_BYTE, rank, lo, hi - lo, MPI_BYTE,
+                 token->memptr_win);
+  chk_err(ierr);
+  CAF_Win_unlock_local(rank, token->memptr_win);
+  dprint("Cached %td bytes at %td of rank %d.\n", hi - lo, lo, rank);
+  e->next = read_cache;
+  read_cache = e;
+  read_cache_bytes += hi - lo;
+  return e->data + (disp - lo);
+}
+
+/* Drop the cached data of token, which this image is going to write. */
+static inline void
+read_cache_write(caf_token_t token)
+{
+  if (read_cache && token && ((mpi_caf_token_t *)token)->cached_size)
+    read_cache_drop(token);
+}
+#else
+#define read_cache_write(token)
+#endif // GCC_GE_7
+
+/* Put size bytes from buf to displacement disp of win on rank.  Token is the
+ * one win belongs to or NULL.  Local and node-local memory is written
+ * directly. */
+static int
+put_bytes(caf_token_t token, MPI_Win win, int rank, MPI_Aint disp,
+          const void *buf, size_t size)
+{
+  void *dst = local_address(token, win, rank, disp);
+  const size_t chunk = transfer_chunk_size();
+  size_t done, n;
+  int ierr = MPI_SUCCESS;
+
+  if (dst)
+  {
+    memcpy(dst, buf, size);
+    return MPI_SUCCESS;
+  }
+#if MPI_VERSION >= 3
+  if (caf_nonblocking_put)
+  {
+    for (done = 0; done < size && ierr == MPI_SUCCESS; done += n)
+    {
+      n = MIN(chunk, size - done);
+      ierr = pending_puts_put(win, rank, disp + done, (const char *)buf + done,
+                              n);
+    }
+    return ierr;
+  }
+#endif
+  CAF_Win_lock(MPI_LOCK_EXCLUSIVE, rank, win);
+  for (done = 0; done < size; done += n)
+  {
+    n = MIN(chunk, size - done);
+    ierr = MPI_Put((const char *)buf + done, n, MPI_BYTE, rank, disp + done, n,
+                   MPI_BYTE, win);
+    chk_err(ierr);
+  }
+  CAF_Win_unlock(rank, win);
+  return ierr;
+}
+
+/* Get size bytes from displacement disp of win on rank into buf.  Token is the
+ * one win belongs to or NULL.  Local and node-local memory is read
+ * directly. */
+static int
+get_bytes(caf_token_t token, MPI_Win win, int rank, MPI_Aint disp, void *buf,
+          size_t size)
+{
+  void *src = local_address(token, win, rank, disp);
+  const size_t chunk = transfer_chunk_size();
+  size_t done, n;
+  int ierr = MPI_SUCCESS;
+
+  if (src)
+  {
+    memcpy(buf, src, size);
+    return MPI_SUCCESS;
+  }
+#ifdef GCC_GE_7
+  if (token && ((mpi_caf_token_t *)token)->cached_size
+      && win == ((mpi_caf_token_t *)token)->memptr_win
+      && (src = (void *)read_cache_lookup(token, rank, disp, size)))
+  {
+    memcpy(buf, src, size);
+    return MPI_SUCCESS;
+  }
+#endif
+  CAF_Win_lock(MPI_LOCK_SHARED, rank, win);
+  for (done = 0; done < size; done += n)
+  {
+    n = MIN(chunk, size - done);
+    ierr = MPI_Get((char *)buf + done, n, MPI_BYTE, rank, disp + done, n,
+                   MPI_BYTE, win);
+    chk_err(ierr);
+  }
+  CAF_Win_unlock_local(rank, win);
+  return ierr;
+}
+
+/* Batches of the accesses of the *_by_ref routines.
+ * The traversal of a reference ends in a get_data() or put_data() for every
+ * contiguous piece of memory, e.g., for each element of obj[p]%comp(1:n:2).
+ * While a batch is open, the pieces that need no conversion are collected
+ * instead of being moved one epoch each.  Adjacent pieces are merged and all
+ * pieces of a window and rank are moved by a single MPI_Get or MPI_Put with
+ * hindexed datatypes on both sides.  The batch is flushed when it holds a
+ * transfer chunk worth of bytes and when it is closed. */
+struct access_batch_piece_t
+{
+  MPI_Win win;
+  int rank;
+  MPI_Aint disp;
+  char *local;
+  /* Zero for pieces that have been moved already. */
+  size_t size;
+};
+
+static struct access_batch_t
+{
+  bool active, put;
+  size_t count, capacity, bytes;
+  struct access_batch_piece_t *pieces;
+} access_batch = {false, false, 0, 0, 0, NULL};
+
+/* Move all pieces of the batch. */
+static void
+access_batch_flush(void)
+{
+  struct access_batch_piece_t *pieces = access_batch.pieces;
+  size_t first, j, n;
+  int ierr;
+
+  for (first = 0; first < access_batch.count; ++first)
+  {
+    const MPI_Win win = pieces[first].win;
+    const int rank = pieces[first].rank;
+    MPI_Datatype local_type, remote_type;
+    MPI_Aint *local_disps, *remote_disps, base;
+    int *lens;
+
+    if (pieces[first].size == 0)
+      continue;
+    for (j = first + 1, n = 1; j < access_batch.count; ++j)
+      if (pieces[j].size != 0 && pieces[j].win == win
+          && pieces[j].rank == rank)
+        ++n;
+    dprint("Moving %zd pieces from/to rank %d in one %s.\n", n, rank,
+           access_batch.put ? "put" : "get");
+
+    if (n == 1)
+    {
+      if (access_batch.put)
+        ierr = put_bytes(NULL, win, rank, pieces[first].disp,
+                         pieces[first].local, pieces[first].size);
+      else
+        ierr = get_bytes(NULL, win, rank, pieces[first].disp,
+                         pieces[first].local, pieces[first].size);
+      chk_err(ierr);
+      pieces[first].size = 0;
+      continue;
+    }
+
+    lens = malloc(n * sizeof(int));
+    local_disps = malloc(n * sizeof(MPI_Aint));
+    remote_disps = malloc(n * sizeof(MPI_Aint));
+    for (j = first, n = 0, base = pieces[first].disp;
+         j < access_batch.count; ++j)
+      if (pieces[j].size != 0 && pieces[j].win == win
+          && pieces[j].rank == rank)
+      {
+        lens[n] = pieces[j].size;
+        ierr = MPI_Get_address(pieces[j].local, &local_disps[n]);
+        chk_err(ierr);
+        remote_disps[n++] = pieces[j].disp;
+        base = MIN(base, pieces[j].disp);
+        pieces[j].size = 0;
+      }
+    /* Dynamic windows need the target displacement to be in the attached
+     * memory, therefore make the remote type relative to the lowest one. */
+    for (j = 0; j < n; ++j)
+      remote_disps[j] -= base;
+    ierr = MPI_Type_create_hindexed(n, lens, local_disps, MPI_BYTE,
+                                    &local_type);
+    chk_err(ierr);
+    ierr = MPI_Type_commit(&local_type);
+    chk_err(ierr);
+    ierr = MPI_Type_create_hindexed(n, lens, remote_disps, MPI_BYTE,
+                                    &remote_type);
+    chk_err(ierr);
+    ierr = MPI_Type_commit(&remote_type);
+    chk_err(ierr);
+
+    if (access_batch.put)
+    {
+      CAF_Win_lock(MPI_LOCK_EXCLUSIVE, rank, win);
+      ierr = MPI_Put(MPI_BOTTOM, 1, local_type, rank, base, 1, remote_type,
+                     win);
+      chk_err(ierr);
+      CAF_Win_unlock(rank, win);
+    }
+    else
+    {
+      CAF_Win_lock(MPI_LOCK_SHARED, rank, win);
+      ierr = MPI_Get(MPI_BOTTOM, 1, local_type, rank, base, 1, remote_type,
+                     win);
+      chk_err(ierr);
+      CAF_Win_unlock_local(rank, win);
+    }
+
+    ierr = MPI_Type_free(&local_type);
+    chk_err(ierr);
+    ierr = MPI_Type_free(&remote_type);
+    chk_err(ierr);
+    free(lens);
+    free(local_disps);
+    free(remote_disps);
+  }
+  access_batch.count = 0;
+  access_batch.bytes = 0;
+}
+
+/* Open a batch of puts, when put is set, or of gets. */
+static void
+access_batch_begin(bool put)
+{
+  access_batch.active = true;
+  access_batch.put = put;
+}
+
+/* Move the pieces of the open batch and close it. */
+static void
+access_batch_end(void)
+{
+  access_batch_flush();
+  access_batch.active = false;
+}
+
+/* Put (when put is set) or get size bytes of local memory to or from
+ * displacement disp of win on rank.  When a batch of the same direction is
+ * open, the transfer is added to it, else it is done immediately like
+ * put_bytes() or get_bytes() do. */
+static int
+access_batch_add(bool put, caf_token_t token, MPI_Win win, int rank,
+                 MPI_Aint disp, void *local, size_t size)
+{
+  struct access_batch_piece_t *last;
+
+  if (!access_batch.active || access_batch.put != put
+      || size > transfer_chunk_size()
+      || local_address(token, win, rank, disp) != NULL)
+    return put ? put_bytes(token, win, rank, disp, local, size)
+               : get_bytes(token, win, rank, disp, local, size);
+  if (size == 0)
+    return MPI_SUCCESS;
+
+  if (access_batch.bytes + size > transfer_chunk_size())
+    access_batch_flush();
+  last = access_batch.count ? &access_batch.pieces[access_batch.count - 1]
+                            : NULL;
+  if (last && last->win == win && last->rank == rank
+      && last->disp + (MPI_Aint)last->size == disp
+      && last->local + last->size == (char *)local)
+    last->size += size;
+  else
+  {
+    if (access_batch.count == access_batch.capacity)
+    {
+      access_batch.capacity
+          = access_batch.capacity ? 2 * access_batch.capacity : 64;
+      access_batch.pieces
+          = realloc(access_batch.pieces,
+                    access_batch.capacity * sizeof(*access_batch.pieces));
+    }
+    last = &access_batch.pieces[access_batch.count++];
+    last->win = win;
+    last->rank = rank;
+    last->disp = disp;
+    last->local = local;
+    last->size = size;
+  }
+  access_batch.bytes += size;
+  return MPI_SUCCESS;
+}
+
+/* Select the epoch model from the environment variable
+ * OPENCOARRAYS_EPOCH_MODEL, which may be "lock" (the default) or "lock_all".
+ * Setting OPENCOARRAYS_NONBLOCKING_PUT to a non-zero value enables the
+ * non-blocking puts and implies "lock_all".  Setting
+ * OPENCOARRAYS_WRITE_COMBINE to the size in bytes of the write-combining
+ * buffers enables write-combining and implies non-blocking puts.  Sizes below
+ * WRITE_COMBINE_MAX_PUT are raised to it.  All images have to agree on the
+ * model, therefore take the one of the first image.  Collective on
+ * CAF_COMM_WORLD. */
+static void
+epoch_model_init(void)
+{
+#if MPI_VERSION >= 3
+  const char *envvar = getenv("OPENCOARRAYS_EPOCH_MODEL");
+  int params[3] = {0, 0, 0}, ierr;
+
+  if (envvar != NULL && *envvar != '\0')
+  {
+    if (strcmp(envvar, "lock_all") == 0)
+      params[0] = 1;
+    else if (strcmp(envvar, "lock") != 0 && caf_this_image == 1)
+      fprintf(stderr,
+              "OpenCoarrays: Unknown epoch model '%s' in "
+              "OPENCOARRAYS_EPOCH_MODEL, using 'lock'.\n",
+              envvar);
+  }
+  /* Non-blocking puts need the long-lived epochs of the lock_all model. */
+  envvar = getenv("OPENCOARRAYS_NONBLOCKING_PUT");
+  if (envvar != NULL && *envvar != '\0' && atoi(envvar) != 0)
+    params[0] = params[1] = 1;
+  envvar = getenv("OPENCOARRAYS_WRITE_COMBINE");
+  if (envvar != NULL && *envvar != '\0' && atoi(envvar) > 0)
+  {
+    params[0] = params[1] = 1;
+    params[2] = MAX(atoi(envvar), WRITE_COMBINE_MAX_PUT);
+  }
+  ierr = MPI_Bcast(params, 3, MPI_INT, 0, CAF_COMM_WORLD);
+  chk_err(ierr);
+  caf_epoch_lock_all = params[0];
+  caf_nonblocking_put = params[1];
+  caf_write_combine = params[2];
+  dprint("Using the %s epoch model%s%s.\n", params[0] ? "lock_all" : "lock",
+         params[1] ? " with non-blocking puts" : "",
+         params[2] ? " and write-combining" : "");
+#endif
+}
+
+/* Initialize coarray program.  This routine assumes that no other
+ * MPI initialization happened before. */
+
+void
+PREFIX(init)(int *argc, char ***argv)
+{
+  int flag;
+  if (caf_num_images == 0)
+  {
+    /* Flag rc as unused, because conditional compilation.  */
+    int ierr = 0, i = 0, j = 0, rc __attribute__((unused)), prov_lev = 0;
+    int is_init = 0, prior_thread_level = MPI_THREAD_MULTIPLE;
     ierr = MPI_Initialized(&is_init);
     chk_err(ierr);
 
@@ -1584,6 +4124,8 @@ PREFIX(init)(int *argc, char ***argv)
     image_stati = (int *)calloc(caf_num_images, sizeof(int));
 #endif
 
+    epoch_model_init();
+
 #if MPI_VERSION >= 3
     ierr = MPI_Info_create(&mpi_info_same_size);
     chk_err(ierr);
@@ -1601,6 +4143,9 @@ PREFIX(init)(int *argc, char ***argv)
     chk_err(ierr);
 #endif // MPI_VERSION
 
+    ierr = MPI_Comm_group(CAF_COMM_WORLD, &caf_initial_group);
+    chk_err(ierr);
+
     /* Create the dynamic window to allow images to asyncronously attach
      * memory. */
     ierr = MPI_Win_create_dynamic(MPI_INFO_NULL, CAF_COMM_WORLD,
@@ -1608,6 +4153,15 @@ PREFIX(init)(int *argc, char ***argv)
     chk_err(ierr);
 
     CAF_Win_lock_all(global_dynamic_win);
+#ifdef GCC_GE_7
+    ierr = MPI_Win_create(&caf_alloc_epoch, sizeof(uint64_t), 1,
+                          MPI_INFO_NULL, CAF_COMM_WORLD, &alloc_epoch_win);
+    chk_err(ierr);
+    CAF_Win_lock_all(alloc_epoch_win);
+    alloc_epoch_seen
+        = calloc(global_num_images, sizeof(struct alloc_epoch_seen_t));
+    symmetric_heap_init();
+#endif
 #ifdef EXTRA_DEBUG_OUTPUT
     if (caf_this_image == 1)
     {
@@ -1622,11 +4176,27 @@ PREFIX(init)(int *argc, char ***argv)
     }
 #endif
 
+#ifdef WITH_COMM_THREAD
+#ifndef GCC_GE_15
+    /* The thread only serves the third party transfers of sendget, which put
+     * from it into windows locked by lock_all. */
+    if (caf_epoch_lock_all
+        && (is_init ? prior_thread_level : prov_lev) == MPI_THREAD_MULTIPLE)
+#endif
+    {
+      ierr = MPI_Comm_dup(CAF_COMM_WORLD, &ct_COMM);
+      chk_err(ierr);
 #ifdef GCC_GE_15
-    ierr = MPI_Comm_dup(CAF_COMM_WORLD, &ct_COMM);
-    chk_err(ierr);
-    ierr = pthread_create(&commthread, NULL, &communication_thread, NULL);
-    chk_err(ierr);
+      ierr = MPI_Win_create_dynamic(MPI_INFO_NULL, CAF_COMM_WORLD,
+                                    &ct_landing_win);
+      chk_err(ierr);
+      ierr = MPI_Win_lock_all(MPI_MODE_NOCHECK, ct_landing_win);
+      chk_err(ierr);
+#endif
+      ierr = pthread_create(&commthread, NULL, &communication_thread, NULL);
+      chk_err(ierr);
+      commthread_started = true;
+    }
 #endif
   }
 }
@@ -1638,6 +4208,7 @@ finalize_internal(int status_code)
 {
   int ierr;
   dprint("(status_code = %d)\n", status_code);
+  pending_accesses_complete();
 
 #ifdef WITH_FAILED_IMAGES
   no_stopped_images_check_in_errhandler = true;
@@ -1711,75 +4282,128 @@ finalize_internal(int status_code)
     return;
 #endif
 
+  dprint("Live tokens at finalize: %zd holding %zd bytes.\n",
+         caf_allocated_tokens.count, caf_allocated_tokens.bytes);
 #ifdef GCC_GE_7
-  struct caf_allocated_slave_tokens_t *cur_stok = caf_allocated_slave_tokens,
-                                      *prev_stok = NULL;
+  dprint("Live slave tokens at finalize: %zd holding %zd bytes.\n",
+         caf_allocated_slave_tokens.count, caf_allocated_slave_tokens.bytes);
+  struct caf_token_entry_t *cur_stok = caf_allocated_slave_tokens.last;
   CAF_Win_unlock_all(global_dynamic_win);
-  while (cur_stok)
+  for (; cur_stok; cur_stok = cur_stok->prev)
   {
-    prev_stok = cur_stok->prev;
-    dprint("freeing slave token %p for memory %p", cur_stok->token,
-           cur_stok->token->memptr);
-    ierr = MPI_Win_detach(global_dynamic_win, cur_stok->token);
-    chk_err(ierr);
-    if (cur_stok->token->memptr)
-    {
-      ierr = MPI_Win_detach(global_dynamic_win, cur_stok->token->memptr);
-      chk_err(ierr);
-      ierr = MPI_Free_mem(cur_stok->token->memptr);
-      chk_err(ierr);
-    }
-    ierr = MPI_Free_mem(cur_stok->token);
-    chk_err(ierr);
-    free(cur_stok);
-    cur_stok = prev_stok;
+    mpi_caf_slave_token_t *slave_token = cur_stok->token;
+    dprint("freeing slave token %p for memory %p", slave_token,
+           slave_token->memptr);
+    if (slave_token->memptr)
+      dynamic_pool_release(slave_token->memptr, slave_token->memptr_size);
+    dynamic_pool_release(slave_token, sizeof(mpi_caf_slave_token_t));
   }
+  token_registry_clear(&caf_allocated_slave_tokens);
+  dynamic_pool_finalize();
 #else
   CAF_Win_unlock_all(global_dynamic_win);
 #endif
 
   dprint("Freed all slave tokens.\n");
-  struct caf_allocated_tokens_t *cur_tok = caf_allocated_tokens,
-                                *prev = caf_allocated_tokens;
+  struct caf_token_entry_t *cur_tok = caf_allocated_tokens.last;
   MPI_Win *p;
 
-  while (cur_tok)
+  for (; cur_tok; cur_tok = cur_tok->prev)
   {
-    prev = cur_tok->prev;
     p = TOKEN(cur_tok->token);
-    if (p != NULL)
-      CAF_Win_unlock_all(*p);
 #ifdef GCC_GE_7
-    /* Unregister the window to the descriptors when freeing the token. */
-    dprint("MPI_Win_free(%p)\n", p);
-    ierr = MPI_Win_free(p);
-    chk_err(ierr);
+    /* Tokens on the symmetric heap are released with the heap below. */
+    if (*p != symmetric_heap_win)
+    {
+      pending_puts_forget(*p);
+      CAF_Win_unlock_all(*p);
+      /* Unregister the window to the descriptors when freeing the token. */
+      dprint("MPI_Win_free(%p)\n", p);
+      ierr = MPI_Win_free(p);
+      chk_err(ierr);
+    }
+    free(TOKEN_WIN_RANKS(cur_tok->token));
     free(cur_tok->token);
 #else  // GCC_GE_7
+    pending_puts_forget(*p);
+    if (p != NULL)
+      CAF_Win_unlock_all(*p);
     ierr = MPI_Win_free(p);
     chk_err(ierr);
 #endif // GCC_GE_7
-    free(cur_tok);
-    cur_tok = prev;
   }
+  token_registry_clear(&caf_allocated_tokens);
+#ifdef GCC_GE_7
+  read_cache_drop(NULL);
+  symmetric_heap_finalize();
+#endif
+#if MPI_VERSION >= 3
+  while (pending_puts_wins)
+    pending_puts_forget(pending_puts[0].win);
+  free(pending_puts);
+  pending_puts = NULL;
+  for (int i = 0; i < async_requests_size; ++i)
+    free(async_requests[i].requests);
+  free(async_requests);
+  async_requests = NULL;
+  async_requests_size = 0;
+#endif
+#ifdef STRIDED
+  datatype_cache_finalize();
+#endif
+  bounce_pool_finalize();
+  ierr = MPI_Group_free(&caf_initial_group);
+  chk_err(ierr);
+  free(caf_team_ranks);
+  caf_team_ranks = NULL;
+  free(access_batch.pieces);
+  access_batch.pieces = NULL;
+  access_batch.capacity = 0;
 #if MPI_VERSION >= 3
   ierr = MPI_Info_free(&mpi_info_same_size);
   chk_err(ierr);
 #endif // MPI_VERSION
 
+#ifdef WITH_COMM_THREAD
+  if (commthread_started)
+  {
+#ifndef WITH_FAILED_IMAGES
+    /* At the regular end of the program other images may still wait for a
+     * request to be executed by this image's thread.  Else the images are
+     * aborted. */
+    if (status_code == 0)
+    {
+      ierr = MPI_Barrier(CAF_COMM_WORLD);
+      chk_err(ierr);
+    }
+#endif
+    dprint("Sending termination signal to communication thread.\n");
+    commthread_running = false;
+    ierr = MPI_Send(NULL, 0, MPI_BYTE, global_this_image, CAF_CT_TAG, ct_COMM);
+    chk_err(ierr);
+    dprint("Termination signal send, waiting for thread join.\n");
+    ierr = pthread_join(commthread, NULL);
+    dprint("Communication thread terminated with rc = %d.\n", ierr);
 #ifdef GCC_GE_15
-  dprint("Sending termination signal to communication thread.\n");
-  commthread_running = false;
-  ierr = MPI_Send(NULL, 0, MPI_BYTE, mpi_this_image, CAF_CT_TAG, ct_COMM);
-  chk_err(ierr);
-  dprint("Termination signal send, waiting for thread join.\n");
-  ierr = pthread_join(commthread, NULL);
-  dprint("Communication thread terminated with rc = %d.\n", ierr);
-  dprint("Freeing ct_COMM.\n");
-  MPI_Comm_free(&ct_COMM);
-  dprint("Freeed ct_COMM.\n");
+    ierr = MPI_Win_unlock_all(ct_landing_win);
+    chk_err(ierr);
+    ierr = MPI_Win_free(&ct_landing_win);
+    chk_err(ierr);
+#endif
+    dprint("Freeing ct_COMM.\n");
+    MPI_Comm_free(&ct_COMM);
+    commthread_started = false;
+    dprint("Freeed ct_COMM.\n");
+  }
 #endif
 
+#ifdef GCC_GE_7
+  CAF_Win_unlock_all(alloc_epoch_win);
+  ierr = MPI_Win_free(&alloc_epoch_win);
+  chk_err(ierr);
+  free(alloc_epoch_seen);
+  alloc_epoch_seen = NULL;
+#endif
   /* Free the global dynamic window. */
   ierr = MPI_Win_free(&global_dynamic_win);
   chk_err(ierr);
@@ -1907,6 +4531,8 @@ void PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
   if (caf_num_images == 0)
     PREFIX(init)(NULL, NULL);
 
+  alloc_epoch_bump();
+
   if (type == CAF_REGTYPE_LOCK_STATIC || type == CAF_REGTYPE_LOCK_ALLOC
       || type == CAF_REGTYPE_CRITICAL || type == CAF_REGTYPE_EVENT_STATIC
       || type == CAF_REGTYPE_EVENT_ALLOC)
@@ -1929,18 +4555,13 @@ void PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
 #ifdef EXTRA_DEBUG_OUTPUT
         MPI_Aint mpi_address = 0;
 #endif
-        CAF_Win_unlock_all(global_dynamic_win);
         if (type == CAF_REGTYPE_COARRAY_ALLOC_REGISTER_ONLY)
         {
-          ierr = MPI_Alloc_mem(sizeof(mpi_caf_slave_token_t), MPI_INFO_NULL,
-                               token);
-          chk_err(ierr);
+          *token = dynamic_pool_alloc(sizeof(mpi_caf_slave_token_t));
           slave_token = (mpi_caf_slave_token_t *)(*token);
           slave_token->memptr = NULL;
           slave_token->desc = NULL;
-          ierr = MPI_Win_attach(global_dynamic_win, slave_token,
-                                sizeof(mpi_caf_slave_token_t));
-          chk_err(ierr);
+          slave_token->memptr_size = 0;
 #ifdef EXTRA_DEBUG_OUTPUT
           ierr = MPI_Get_address(*token, &mpi_address);
           chk_err(ierr);
@@ -1951,21 +4572,19 @@ void PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
                  global_dynamic_win);
 
           /* Register the memory for auto freeing. */
-          struct caf_allocated_slave_tokens_t *tmp
-              = malloc(sizeof(struct caf_allocated_slave_tokens_t));
-          tmp->prev = caf_allocated_slave_tokens;
-          tmp->token = slave_token;
-          caf_allocated_slave_tokens = tmp;
+          token_registry_add(&caf_allocated_slave_tokens, slave_token, NULL, 0);
         }
         else // (type == CAF_REGTYPE_COARRAY_ALLOC_ALLOCATE_ONLY)
         {
-          int ierr;
           slave_token = (mpi_caf_slave_token_t *)(*token);
-          ierr = MPI_Alloc_mem(actual_size, MPI_INFO_NULL, &mem);
-          chk_err(ierr);
+          struct caf_token_entry_t **entry
+              = token_registry_lookup(&caf_allocated_slave_tokens, slave_token);
+          mem = dynamic_pool_alloc(actual_size);
           slave_token->memptr = mem;
-          ierr = MPI_Win_attach(global_dynamic_win, mem, actual_size);
-          chk_err(ierr);
+          slave_token->memptr_size = actual_size;
+          if (entry)
+            token_registry_resize(&caf_allocated_slave_tokens, *entry, mem,
+                                  actual_size);
 #ifdef EXTRA_DEBUG_OUTPUT
           ierr = MPI_Get_address(mem, &mpi_address);
           chk_err(ierr);
@@ -1987,7 +4606,6 @@ void PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
                    ierr);
           }
         }
-        CAF_Win_lock_all(global_dynamic_win);
         dprint("Slave token %p on exit: mpi_caf_slave_token_t { memptr: %p, "
                "desc: %p }\n",
                slave_token, slave_token->memptr, slave_token->desc);
@@ -2002,18 +4620,31 @@ void PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
         mpi_token = (mpi_caf_token_t *)(*token);
         p = TOKEN(mpi_token);
 
+        /* The heap's offsets are only the same on all images, when all of
+         * them take part in the allocation, i.e. in the initial team. */
+        if (used_teams->prev == NULL
+            && symmetric_heap_alloc(mpi_token, actual_size))
+        {
+          mem = mpi_token->memptr;
+          dprint("Carved %zd bytes at offset %td from the symmetric heap.\n",
+                 mpi_token->memptr_size, mpi_token->memptr_disp);
+        }
+        else
+        {
 #if MPI_VERSION >= 3
-        ierr = MPI_Win_allocate(actual_size, 1, MPI_INFO_NULL, CAF_COMM_WORLD,
-                                &mem, p);
-        chk_err(ierr);
-        CAF_Win_lock_all(*p);
+          ierr = MPI_Win_allocate(actual_size, 1, MPI_INFO_NULL,
+                                  CAF_COMM_WORLD, &mem, p);
+          chk_err(ierr);
+          CAF_Win_lock_all(*p);
 #else
-        ierr = MPI_Alloc_mem(actual_size, MPI_INFO_NULL, &mem);
-        chk_err(ierr);
-        ierr = MPI_Win_create(mem, actual_size, 1, MPI_INFO_NULL,
-                              CAF_COMM_WORLD, p);
-        chk_err(ierr);
+          ierr = MPI_Alloc_mem(actual_size, MPI_INFO_NULL, &mem);
+          chk_err(ierr);
+          ierr = MPI_Win_create(mem, actual_size, 1, MPI_INFO_NULL,
+                                CAF_COMM_WORLD, p);
+          chk_err(ierr);
 #endif // MPI_VERSION
+          mpi_token->memptr_win_ranks = win_ranks_create(*p);
+        }
 
 #ifndef GCC_GE_8
         if (GFC_DESCRIPTOR_RANK(desc) != 0)
@@ -2024,18 +4655,14 @@ void PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
         {
           init_array = (int *)calloc(size, sizeof(int));
           CAF_Win_lock(MPI_LOCK_EXCLUSIVE, mpi_this_image, *p);
-          ierr = MPI_Put(init_array, size, MPI_INT, mpi_this_image, 0, size,
-                         MPI_INT, *p);
+          ierr = MPI_Put(init_array, size, MPI_INT, mpi_this_image,
+                         mpi_token->memptr_disp, size, MPI_INT, *p);
           chk_err(ierr);
           CAF_Win_unlock(mpi_this_image, *p);
           free(init_array);
         }
 
-        struct caf_allocated_tokens_t *tmp
-            = malloc(sizeof(struct caf_allocated_tokens_t));
-        tmp->prev = caf_allocated_tokens;
-        tmp->token = *token;
-        caf_allocated_tokens = tmp;
+        token_registry_add(&caf_allocated_tokens, *token, mem, actual_size);
 
         if (stat)
           *stat = 0;
@@ -2134,11 +4761,7 @@ void *PREFIX(register)(size_t size, caf_register_t type, caf_token_t *token,
 
   PREFIX(sync_all)(NULL, NULL, 0);
 
-  struct caf_allocated_tokens_t *tmp
-      = malloc(sizeof(struct caf_allocated_tokens_t));
-  tmp->prev = caf_allocated_tokens;
-  tmp->token = *token;
-  caf_allocated_tokens = tmp;
+  token_registry_add(&caf_allocated_tokens, *token, mem, actual_size);
 
   if (stat)
     *stat = 0;
@@ -2206,8 +4829,10 @@ PREFIX(deregister)(caf_token_t *token, int *stat, char *errmsg,
 
   if (stat)
     *stat = 0;
+  pending_accesses_complete();
 
 #ifdef GCC_GE_7
+  alloc_epoch_bump();
   if (type != CAF_DEREGTYPE_COARRAY_DEALLOCATE_ONLY)
   {
     /* Sync all images only, when deregistering the token. Just freeing the
@@ -2221,87 +4846,61 @@ PREFIX(deregister)(caf_token_t *token, int *stat, char *errmsg,
   }
 #endif // GCC_GE_7
   {
-    struct caf_allocated_tokens_t *cur = caf_allocated_tokens,
-                                  *next = caf_allocated_tokens, *prev;
-    MPI_Win *p;
+    struct caf_token_entry_t **entry
+        = token_registry_lookup(&caf_allocated_tokens, *token);
 
-    while (cur)
+    if (entry)
     {
-      prev = cur->prev;
-
-      if (cur->token == *token)
-      {
-        p = TOKEN(*token);
+      MPI_Win *p = TOKEN(*token);
 #ifdef GCC_GE_7
-        dprint("Found regular token %p for memptr_win: %d.\n", *token,
-               ((mpi_caf_token_t *)*token)->memptr_win);
+      dprint("Found regular token %p for memptr_win: %d.\n", *token,
+             ((mpi_caf_token_t *)*token)->memptr_win);
+      if (*p == symmetric_heap_win)
+        symmetric_heap_release((mpi_caf_token_t *)*token);
+      else
 #endif
+      {
+        pending_puts_forget(*p);
         CAF_Win_unlock_all(*p);
         ierr = MPI_Win_free(p);
         chk_err(ierr);
-
-        next->prev = prev ? prev->prev : NULL;
-
-        if (cur == caf_allocated_tokens)
-          caf_allocated_tokens = prev;
-
-        free(cur);
-        free(*token);
-        return;
       }
-      next = cur;
-      cur = prev;
+
+      token_registry_remove(&caf_allocated_tokens, entry);
+#ifdef GCC_GE_7
+      free(TOKEN_WIN_RANKS(*token));
+      ref_plans_free((mpi_caf_token_t *)*token);
+      read_cache_write(*token);
+#endif
+      free(*token);
+      return;
     }
   }
 
 #ifdef GCC_GE_7
   /* Feel through: Has to be a component token. */
   {
-    struct caf_allocated_slave_tokens_t *cur_stok = caf_allocated_slave_tokens,
-                                        *next_stok = caf_allocated_slave_tokens,
-                                        *prev_stok;
+    struct caf_token_entry_t **entry
+        = token_registry_lookup(&caf_allocated_slave_tokens, *token);
 
-    while (cur_stok)
+    if (entry)
     {
-      prev_stok = cur_stok->prev;
-
-      if (cur_stok->token == *token)
-      {
-        dprint("Found sub token %p.\n", *token);
+      dprint("Found sub token %p.\n", *token);
 
-        mpi_caf_slave_token_t *slave_token = *(mpi_caf_slave_token_t **)token;
-        CAF_Win_unlock_all(global_dynamic_win);
+      mpi_caf_slave_token_t *slave_token = *(mpi_caf_slave_token_t **)token;
 
-        if (slave_token->memptr)
-        {
-          ierr = MPI_Win_detach(global_dynamic_win, slave_token->memptr);
-          chk_err(ierr);
-          ierr = MPI_Free_mem(slave_token->memptr);
-          chk_err(ierr);
-          slave_token->memptr = NULL;
-          if (type == CAF_DEREGTYPE_COARRAY_DEALLOCATE_ONLY)
-          {
-            CAF_Win_lock_all(global_dynamic_win);
-            return; // All done.
-          }
-        }
-        ierr = MPI_Win_detach(global_dynamic_win, slave_token);
-        chk_err(ierr);
-        CAF_Win_lock_all(global_dynamic_win);
-
-        next_stok->prev = prev_stok ? prev_stok->prev : NULL;
-
-        if (cur_stok == caf_allocated_slave_tokens)
-          caf_allocated_slave_tokens = prev_stok;
-
-        free(cur_stok);
-        ierr = MPI_Free_mem(*token);
-        chk_err(ierr);
-        return;
+      if (slave_token->memptr)
+      {
+        dynamic_pool_release(slave_token->memptr, slave_token->memptr_size);
+        slave_token->memptr = NULL;
+        token_registry_resize(&caf_allocated_slave_tokens, *entry, NULL, 0);
+        if (type == CAF_DEREGTYPE_COARRAY_DEALLOCATE_ONLY)
+          return; // All done.
       }
+      dynamic_pool_release(slave_token, sizeof(mpi_caf_slave_token_t));
 
-      next_stok = cur_stok;
-      cur_stok = prev_stok;
+      token_registry_remove(&caf_allocated_slave_tokens, entry);
+      return;
     }
   }
 #endif // GCC_GE_7
@@ -2318,9 +4917,7 @@ PREFIX(sync_memory)(int *stat __attribute__((unused)),
                     char *errmsg __attribute__((unused)),
                     charlen_t errmsg_len __attribute__((unused)))
 {
-#if defined(NONBLOCKING_PUT) && !defined(CAF_MPI_LOCK_UNLOCK)
-  explicit_flush();
-#endif
+  pending_accesses_complete();
 }
 
 void
@@ -2335,9 +4932,7 @@ PREFIX(sync_all)(int *stat, char *errmsg, charlen_t errmsg_len)
   }
   else
   {
-#if defined(NONBLOCKING_PUT) && !defined(CAF_MPI_LOCK_UNLOCK)
-    explicit_flush();
-#endif
+    pending_accesses_complete();
 
 #ifdef WITH_FAILED_IMAGES
     ierr = MPI_Barrier(alive_comm);
@@ -2346,6 +4941,7 @@ PREFIX(sync_all)(int *stat, char *errmsg, charlen_t errmsg_len)
     ierr = MPI_Barrier(CAF_COMM_WORLD);
     chk_err(ierr);
 #endif
+    shared_memory_fence();
     dprint("MPI_Barrier = %d.\n", err);
     if (ierr == STAT_FAILED_IMAGE)
       err = STAT_FAILED_IMAGE;
@@ -2385,8 +4981,8 @@ PREFIX(sync_all)(int *stat, char *errmsg, charlen_t errmsg_len)
 /* Convert kind 4 characters into kind 1 one.
  * Copied from the gcc:libgfortran/caf/single.c. */
 static void
-assign_char4_from_char1(size_t dst_size, size_t src_size, uint32_t *dst,
-                        unsigned char *src)
+assign_char4_from_char1(size_t dst_size, size_t src_size,
+                        uint32_t *restrict dst, unsigned char *restrict src)
 {
   size_t i, n;
   n = (dst_size > src_size) ? src_size : dst_size;
@@ -2403,8 +4999,8 @@ assign_char4_from_char1(size_t dst_size, size_t src_size, uint32_t *dst,
 /* Convert kind 1 characters into kind 4 one.
  * Copied from the gcc:libgfortran/caf/single.c. */
 static void
-assign_char1_from_char4(size_t dst_size, size_t src_size, unsigned char *dst,
-                        uint32_t *src)
+assign_char1_from_char4(size_t dst_size, size_t src_size,
+                        unsigned char *restrict dst, uint32_t *restrict src)
 {
   size_t i, n;
   n = (dst_size > src_size) ? src_size : dst_size;
@@ -2416,33 +5012,34 @@ assign_char1_from_char4(size_t dst_size, size_t src_size, unsigned char *dst,
     memset(&dst[n], ' ', dst_size - n);
 }
 
-/* Convert convertable types.
- * Copied from the gcc:libgfortran/caf/single.c. Can't say much about it. */
-static void
-convert_type(void *dst, int dst_type, int dst_kind, void *src, int src_type,
-             int src_kind, int *stat)
-{
+/* The widest types of each kind of numbers. */
 #ifdef HAVE_GFC_INTEGER_16
-  typedef __int128 int128t;
+typedef __int128 int128t;
 #else
-  typedef int64_t int128t;
+typedef int64_t int128t;
 #endif
 
 #if defined(GFC_REAL_16_IS_LONG_DOUBLE)
-  typedef long double real128t;
-  typedef _Complex long double complex128t;
+typedef long double real128t;
+typedef _Complex long double complex128t;
 #elif defined(HAVE_GFC_REAL_16)
-  typedef _Complex float __attribute__((mode(TC))) __complex128;
-  typedef __float128 real128t;
-  typedef __complex128 complex128t;
+typedef _Complex float __attribute__((mode(TC))) __complex128;
+typedef __float128 real128t;
+typedef __complex128 complex128t;
 #elif defined(HAVE_GFC_REAL_10)
-  typedef long double real128t;
-  typedef long double complex128t;
+typedef long double real128t;
+typedef long double complex128t;
 #else
-  typedef double real128t;
-  typedef _Complex double complex128t;
+typedef double real128t;
+typedef _Complex double complex128t;
 #endif
 
+/* Convert convertable types.
+ * Copied from the gcc:libgfortran/caf/single.c. Can't say much about it. */
+static void
+convert_type(void *dst, int dst_type, int dst_kind, void *src, int src_type,
+             int src_kind, int *stat)
+{
   int128t int_val = 0;
   real128t real_val = 0;
   complex128t cmpx_val = 0;
@@ -2681,21 +5278,315 @@ error:
     abort();
 }
 
+/* Bulk conversion kernels
+ * One kernel is generated for each pair of numeric types and kinds, that
+ * converts num items between arrays with the given strides in bytes.  The
+ * loops of the contiguous cases and of the broadcast of a scalar are simple
+ * enough for the compiler to vectorize them. */
+typedef void (*convert_kernel_t)(void *dst, ptrdiff_t dst_stride,
+                                 const void *src, ptrdiff_t src_stride,
+                                 size_t num);
+
+#ifdef HAVE_GFC_INTEGER_16
+#define CONVERT_IF_INTEGER_16(...) __VA_ARGS__
+#else
+#define CONVERT_IF_INTEGER_16(...)
+#endif
+#ifdef HAVE_GFC_REAL_10
+#define CONVERT_IF_REAL_10(...) __VA_ARGS__
+#else
+#define CONVERT_IF_REAL_10(...)
+#endif
+#ifdef HAVE_GFC_REAL_16
+#define CONVERT_IF_REAL_16(...) __VA_ARGS__
+#else
+#define CONVERT_IF_REAL_16(...)
+#endif
+
+/* The convertable types as X(type, kind, name, C type).  The list is given
+ * twice, for X(...) to expand the other one for the pairs. */
+#define CONVERT_TYPES(X)                                                       \
+  X(BT_INTEGER, 1, i1, int8_t)                                                 \
+  X(BT_INTEGER, 2, i2, int16_t)                                                \
+  X(BT_INTEGER, 4, i4, int32_t)                                                \
+  X(BT_INTEGER, 8, i8, int64_t)                                                \
+  CONVERT_IF_INTEGER_16(X(BT_INTEGER, 16, i16, int128t))                       \
+  X(BT_REAL, 4, r4, float)                                                     \
+  X(BT_REAL, 8, r8, double)                                                    \
+  CONVERT_IF_REAL_10(X(BT_REAL, 10, r10, long double))                         \
+  CONVERT_IF_REAL_16(X(BT_REAL, 16, r16, real128t))                            \
+  X(BT_COMPLEX, 4, c4, _Complex float)                                         \
+  X(BT_COMPLEX, 8, c8, _Complex double)                                        \
+  CONVERT_IF_REAL_10(X(BT_COMPLEX, 10, c10, _Complex long double))             \
+  CONVERT_IF_REAL_16(X(BT_COMPLEX, 16, c16, complex128t))
+#define CONVERT_TYPES_PAIRED(X, ...)                                           \
+  X(__VA_ARGS__, BT_INTEGER, 1, i1, int8_t)                                    \
+  X(__VA_ARGS__, BT_INTEGER, 2, i2, int16_t)                                   \
+  X(__VA_ARGS__, BT_INTEGER, 4, i4, int32_t)                                   \
+  X(__VA_ARGS__, BT_INTEGER, 8, i8, int64_t)                                   \
+  CONVERT_IF_INTEGER_16(X(__VA_ARGS__, BT_INTEGER, 16, i16, int128t))          \
+  X(__VA_ARGS__, BT_REAL, 4, r4, float)                                        \
+  X(__VA_ARGS__, BT_REAL, 8, r8, double)                                       \
+  CONVERT_IF_REAL_10(X(__VA_ARGS__, BT_REAL, 10, r10, long double))            \
+  CONVERT_IF_REAL_16(X(__VA_ARGS__, BT_REAL, 16, r16, real128t))               \
+  X(__VA_ARGS__, BT_COMPLEX, 4, c4, _Complex float)                            \
+  X(__VA_ARGS__, BT_COMPLEX, 8, c8, _Complex double)                           \
+  CONVERT_IF_REAL_10(                                                          \
+      X(__VA_ARGS__, BT_COMPLEX, 10, c10, _Complex long double))               \
+  CONVERT_IF_REAL_16(X(__VA_ARGS__, BT_COMPLEX, 16, c16, complex128t))
+
+#define CONVERT_KERNEL(s_type, s_kind, s_name, s_t, d_type, d_kind, d_name,   \
+                       d_t)                                                    \
+  static void convert_##s_name##_to_##d_name(void *dst, ptrdiff_t dst_stride, \
+                                             const void *src,                  \
+                                             ptrdiff_t src_stride, size_t num) \
+  {                                                                            \
+    size_t i;                                                                  \
+    if (dst_stride == sizeof(d_t) && src_stride == sizeof(s_t))                \
+    {                                                                          \
+      d_t *restrict d = dst;                                                   \
+      const s_t *restrict s = src;                                             \
+      for (i = 0; i < num; ++i)                                                \
+        d[i] = (d_t)s[i];                                                      \
+    }                                                                          \
+    else if (dst_stride == sizeof(d_t) && src_stride == 0)                     \
+    {                                                                          \
+      d_t *restrict d = dst;                                                   \
+      const d_t v = (d_t) * (const s_t *)src;                                  \
+      for (i = 0; i < num; ++i)                                                \
+        d[i] = v;                                                              \
+    }                                                                          \
+    else                                                                       \
+      for (i = 0; i < num; ++i)                                                \
+        *(d_t *)((char *)dst + i * dst_stride)                                 \
+            = (d_t) * (const s_t *)((const char *)src + i * src_stride);       \
+  }
+#define CONVERT_KERNELS_FROM(type, kind, name, t)                              \
+  CONVERT_TYPES_PAIRED(CONVERT_KERNEL, type, kind, name, t)
+CONVERT_TYPES(CONVERT_KERNELS_FROM)
+
+#define CONVERT_INDEX(type, kind, name, t) CONVERT_INDEX_##name,
+enum
+{
+  CONVERT_TYPES(CONVERT_INDEX) CONVERT_NUM_TYPES
+};
+
+#define CONVERT_KERNEL_ENTRY(s_type, s_kind, s_name, s_t, d_type, d_kind,     \
+                             d_name, d_t)                                      \
+  [CONVERT_INDEX_##d_name] = convert_##s_name##_to_##d_name,
+#define CONVERT_KERNELS_ROW(type, kind, name, t)                               \
+  [CONVERT_INDEX_##name]                                                       \
+      = {CONVERT_TYPES_PAIRED(CONVERT_KERNEL_ENTRY, type, kind, name, t)},
+static const convert_kernel_t convert_kernels[CONVERT_NUM_TYPES]
+                                             [CONVERT_NUM_TYPES]
+    = {CONVERT_TYPES(CONVERT_KERNELS_ROW)};
+
+/* Return the index of type and kind into convert_kernels or -1. */
+static int
+convert_index(int type, int kind)
+{
+#define CONVERT_INDEX_CASE(type_, kind_, name, t)                              \
+  if (type == type_ && kind == kind_)                                          \
+    return CONVERT_INDEX_##name;
+  CONVERT_TYPES(CONVERT_INDEX_CASE)
+  return -1;
+#undef CONVERT_INDEX_CASE
+}
+
+#undef CONVERT_KERNELS_ROW
+#undef CONVERT_KERNEL_ENTRY
+#undef CONVERT_INDEX
+#undef CONVERT_KERNELS_FROM
+#undef CONVERT_KERNEL
+#undef CONVERT_TYPES_PAIRED
+#undef CONVERT_TYPES
+#undef CONVERT_IF_REAL_16
+#undef CONVERT_IF_REAL_10
+#undef CONVERT_IF_INTEGER_16
+
+/* Convert num items of type src_type and kind src_kind into dst_type of kind
+ * dst_kind, stepping by the given strides in bytes. */
 static void
 convert_with_strides(void *dst, int dst_type, int dst_kind,
                      ptrdiff_t byte_dst_stride, void *src, int src_type,
                      int src_kind, ptrdiff_t byte_src_stride, size_t num,
                      int *stat)
 {
-  /* Compute the step from one item to convert to the next in bytes. The stride
-   * is expected to be the one or similar to the array.stride, i.e. *_stride is
-   * expected to be >= 1 to progress from one item to the next. */
+  const int dst_index = convert_index(dst_type, dst_kind),
+            src_index = convert_index(src_type, src_kind);
+
+  if (dst_index >= 0 && src_index >= 0)
+  {
+    convert_kernels[src_index][dst_index](dst, byte_dst_stride, src,
+                                          byte_src_stride, num);
+    return;
+  }
+  /* Let convert_type() report the error.  The stride is expected to be the
+   * one or similar to the array.stride, i.e. *_stride is expected to be >= 1
+   * to progress from one item to the next. */
   for (size_t i = 0; i < num; ++i)
   {
-    convert_type(dst, dst_type, dst_kind, src, src_type, src_kind, stat);
-    dst += byte_dst_stride;
-    src += byte_src_stride;
+    convert_type(dst, dst_type, dst_kind, src, src_type, src_kind, stat);
+    dst += byte_dst_stride;
+    src += byte_src_stride;
+  }
+}
+
+/* Put num items of src_type and src_kind, which are src_stride bytes apart in
+ * src, to displacement disp of win on rank as items of dst_type and dst_kind
+ * of dst_size bytes each.  A src_stride of zero replicates a scalar.  The
+ * items are converted chunk by chunk into two alternating staging buffers, so
+ * that the conversion of a chunk overlaps with the put of the previous one.
+ * Token is the one win belongs to or NULL. */
+static int
+put_converted(caf_token_t token, MPI_Win win, int rank, MPI_Aint disp,
+              int dst_type, int dst_kind, size_t dst_size, void *src,
+              int src_type, int src_kind, ptrdiff_t src_stride, size_t num,
+              int *stat)
+{
+  void *dst = local_address(token, win, rank, disp), *buf[2] = {NULL, NULL};
+  const size_t chunk = MAX(transfer_chunk_size() / dst_size, 1);
+  size_t done, n;
+  int ierr = MPI_SUCCESS, k;
+
+  if (dst)
+  {
+    convert_with_strides(dst, dst_type, dst_kind, dst_size, src, src_type,
+                         src_kind, src_stride, num, stat);
+    return MPI_SUCCESS;
+  }
+  if (num == 0)
+    return MPI_SUCCESS;
+
+  buf[0] = bounce_alloc(MIN(chunk, num) * dst_size);
+  if (num > chunk)
+    buf[1] = bounce_alloc(chunk * dst_size);
+#if MPI_VERSION >= 3
+  if (!caf_nonblocking_put)
+  {
+    MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+
+    CAF_Win_lock(MPI_LOCK_EXCLUSIVE, rank, win);
+    for (done = 0, k = 0; done < num; done += n, k ^= 1)
+    {
+      n = MIN(chunk, num - done);
+      /* Wait for the put from this buffer to complete locally. */
+      ierr = MPI_Wait(&req[k], MPI_STATUS_IGNORE);
+      chk_err(ierr);
+      convert_with_strides(buf[k], dst_type, dst_kind, dst_size,
+                           (char *)src + done * src_stride, src_type, src_kind,
+                           src_stride, n, stat);
+      ierr = MPI_Rput(buf[k], n * dst_size, MPI_BYTE, rank,
+                      disp + done * dst_size, n * dst_size, MPI_BYTE, win,
+                      &req[k]);
+      chk_err(ierr);
+    }
+    ierr = MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+    chk_err(ierr);
+    CAF_Win_unlock(rank, win);
+  }
+  else
+#endif
+    for (done = 0, k = 0; done < num && ierr == MPI_SUCCESS; done += n, k ^= 1)
+    {
+      n = MIN(chunk, num - done);
+      convert_with_strides(buf[k], dst_type, dst_kind, dst_size,
+                           (char *)src + done * src_stride, src_type, src_kind,
+                           src_stride, n, stat);
+      ierr = put_bytes(NULL, win, rank, disp + done * dst_size, buf[k],
+                       n * dst_size);
+    }
+
+  bounce_release(buf[0]);
+  if (buf[1])
+    bounce_release(buf[1]);
+  return ierr;
+}
+
+/* Get num items of src_type and src_kind of src_size bytes each from
+ * displacement disp of win on rank into dst as items of dst_type and dst_kind,
+ * which are dst_size bytes apart.  When src_is_scalar, a single remote item is
+ * replicated.  The chunk after the one being converted is already in flight
+ * into the other of two staging buffers.  Token is the one win belongs to or
+ * NULL. */
+static int
+get_converted(caf_token_t token, MPI_Win win, int rank, MPI_Aint disp,
+              void *dst, int dst_type, int dst_kind, size_t dst_size,
+              int src_type, int src_kind, size_t src_size, bool src_is_scalar,
+              size_t num, int *stat)
+{
+  void *src = local_address(token, win, rank, disp), *buf[2] = {NULL, NULL};
+  const ptrdiff_t src_stride = src_is_scalar ? 0 : src_size;
+  const size_t chunk = MAX(transfer_chunk_size() / src_size, 1);
+  size_t done, n;
+  int ierr = MPI_SUCCESS, k;
+
+  if (src)
+  {
+    convert_with_strides(dst, dst_type, dst_kind, dst_size, src, src_type,
+                         src_kind, src_stride, num, stat);
+    return MPI_SUCCESS;
+  }
+  if (num == 0)
+    return MPI_SUCCESS;
+
+  if (src_is_scalar)
+  {
+    buf[0] = bounce_alloc(src_size);
+    ierr = get_bytes(NULL, win, rank, disp, buf[0], src_size);
+    convert_with_strides(dst, dst_type, dst_kind, dst_size, buf[0], src_type,
+                         src_kind, 0, num, stat);
+    bounce_release(buf[0]);
+    return ierr;
+  }
+
+  buf[0] = bounce_alloc(MIN(chunk, num) * src_size);
+  if (num > chunk)
+    buf[1] = bounce_alloc(chunk * src_size);
+#if MPI_VERSION >= 3
+  {
+    MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+
+    CAF_Win_lock(MPI_LOCK_SHARED, rank, win);
+    n = MIN(chunk, num);
+    ierr = MPI_Rget(buf[0], n * src_size, MPI_BYTE, rank, disp, n * src_size,
+                    MPI_BYTE, win, &req[0]);
+    chk_err(ierr);
+    for (done = 0, k = 0; done < num; done += n, k ^= 1)
+    {
+      n = MIN(chunk, num - done);
+      if (done + n < num)
+      {
+        const size_t next = MIN(chunk, num - done - n);
+        ierr = MPI_Rget(buf[k ^ 1], next * src_size, MPI_BYTE, rank,
+                        disp + (done + n) * src_size, next * src_size,
+                        MPI_BYTE, win, &req[k ^ 1]);
+        chk_err(ierr);
+      }
+      ierr = MPI_Wait(&req[k], MPI_STATUS_IGNORE);
+      chk_err(ierr);
+      convert_with_strides((char *)dst + done * dst_size, dst_type, dst_kind,
+                           dst_size, buf[k], src_type, src_kind, src_size, n,
+                           stat);
+    }
+    CAF_Win_unlock_local(rank, win);
+  }
+#else
+  for (done = 0, k = 0; done < num && ierr == MPI_SUCCESS; done += n, k ^= 1)
+  {
+    n = MIN(chunk, num - done);
+    ierr = get_bytes(NULL, win, rank, disp + done * src_size, buf[k],
+                     n * src_size);
+    convert_with_strides((char *)dst + done * dst_size, dst_type, dst_kind,
+                         dst_size, buf[k], src_type, src_kind, src_size, n,
+                         stat);
   }
+#endif
+
+  bounce_release(buf[0]);
+  if (buf[1])
+    bounce_release(buf[1]);
+  return ierr;
 }
 
 static void
@@ -2824,6 +5715,347 @@ selectType(int size, MPI_Datatype *dt)
 #undef SELTYPE
 }
 
+#ifdef STRIDED
+/* Cache of committed datatypes
+ * The strided transfers of a program tend to repeat the same sections, e.g.,
+ * the halos of each time step.  Their datatypes are kept committed in a cache
+ * of bounded size, keyed by the base type and the extents and strides of the
+ * section, evicting the least recently used one when it is full.  Its size is
+ * set by OPENCOARRAYS_DATATYPE_CACHE_SIZE, zero disables it.  Setting
+ * OPENCOARRAYS_DATATYPE_CACHE_STATS to a non-zero value lets each image
+ * report the cache's hits and misses at finalization. */
+#define DATATYPE_CACHE_DEFAULT_SIZE 64
+
+struct datatype_cache_entry_t
+{
+  /* MPI_DATATYPE_NULL for unused entries. */
+  MPI_Datatype dt;
+  MPI_Datatype base_type;
+  int rank;
+  size_t hash;
+  unsigned long long last_use;
+  ptrdiff_t extent[GFC_MAX_DIMENSIONS], stride[GFC_MAX_DIMENSIONS];
+};
+
+static struct datatype_cache_entry_t *datatype_cache = NULL;
+/* The number of entries in the cache, -1 until initialized. */
+static int datatype_cache_size = -1;
+static unsigned long long datatype_cache_tick = 0, datatype_cache_hits = 0,
+                          datatype_cache_misses = 0;
+
+static void
+datatype_cache_init(void)
+{
+  const char *envvar = getenv("OPENCOARRAYS_DATATYPE_CACHE_SIZE");
+  int i;
+
+  datatype_cache_size = DATATYPE_CACHE_DEFAULT_SIZE;
+  if (envvar != NULL && *envvar != '\0')
+    datatype_cache_size = atoi(envvar);
+  /* Two types are in use at the same time, which must not evict each
+   * other. */
+  if (datatype_cache_size < 0)
+    datatype_cache_size = 0;
+  else if (datatype_cache_size == 1)
+    datatype_cache_size = 2;
+  datatype_cache
+      = malloc(datatype_cache_size * sizeof(struct datatype_cache_entry_t));
+  for (i = 0; i < datatype_cache_size; ++i)
+    datatype_cache[i].dt = MPI_DATATYPE_NULL;
+}
+
+/* Free all cached datatypes and report the statistics. */
+static void
+datatype_cache_finalize(void)
+{
+  const char *envvar = getenv("OPENCOARRAYS_DATATYPE_CACHE_STATS");
+  int i, ierr;
+
+  if (datatype_cache_size < 0)
+    return;
+  dprint("Datatype cache: %llu hits, %llu misses.\n", datatype_cache_hits,
+         datatype_cache_misses);
+  if (envvar != NULL && *envvar != '\0' && atoi(envvar) != 0)
+    fprintf(stderr, "OpenCoarrays: image %d: datatype cache: %llu hits, %llu "
+                    "misses.\n",
+            caf_this_image, datatype_cache_hits, datatype_cache_misses);
+  for (i = 0; i < datatype_cache_size; ++i)
+    if (datatype_cache[i].dt != MPI_DATATYPE_NULL)
+    {
+      ierr = MPI_Type_free(&datatype_cache[i].dt);
+      chk_err(ierr);
+    }
+  free(datatype_cache);
+  datatype_cache = NULL;
+  datatype_cache_size = -1;
+}
+
+/* Return the committed datatype of the elements of type base_type, that are
+ * laid out in rank dimensions with the given extents and strides in
+ * elements.  It is a nest of hvectors, one per dimension, taken from the cache
+ * when possible. */
+static MPI_Datatype
+hvector_type(MPI_Datatype base_type, int rank, const ptrdiff_t *extent,
+             const ptrdiff_t *stride)
+{
+  struct datatype_cache_entry_t *entry = NULL;
+  MPI_Datatype dt = base_type, next;
+  MPI_Aint lb, base_extent;
+  size_t hash = (size_t)rank;
+  int ierr, j;
+
+  if (datatype_cache_size < 0)
+    datatype_cache_init();
+
+  for (j = 0; j < rank; ++j)
+    hash = (hash * 31 + (size_t)extent[j]) * 31 + (size_t)stride[j];
+  for (j = 0; j < datatype_cache_size; ++j)
+  {
+    struct datatype_cache_entry_t *cur = &datatype_cache[j];
+
+    if (cur->dt != MPI_DATATYPE_NULL && cur->hash == hash
+        && cur->base_type == base_type && cur->rank == rank
+        && !memcmp(cur->extent, extent, rank * sizeof(ptrdiff_t))
+        && !memcmp(cur->stride, stride, rank * sizeof(ptrdiff_t)))
+    {
+      ++datatype_cache_hits;
+      cur->last_use = ++datatype_cache_tick;
+      return cur->dt;
+    }
+    if (entry == NULL || cur->dt == MPI_DATATYPE_NULL
+        || (entry->dt != MPI_DATATYPE_NULL && cur->last_use < entry->last_use))
+      entry = cur;
+  }
+  ++datatype_cache_misses;
+
+  ierr = MPI_Type_get_extent(base_type, &lb, &base_extent);
+  chk_err(ierr);
+  for (j = 0; j < rank; ++j)
+  {
+    ierr = MPI_Type_create_hvector(extent[j], 1, stride[j] * base_extent, dt,
+                                   &next);
+    chk_err(ierr);
+    if (dt != base_type)
+    {
+      ierr = MPI_Type_free(&dt);
+      chk_err(ierr);
+    }
+    dt = next;
+  }
+  ierr = MPI_Type_commit(&dt);
+  chk_err(ierr);
+
+  if (entry != NULL)
+  {
+    if (entry->dt != MPI_DATATYPE_NULL)
+    {
+      ierr = MPI_Type_free(&entry->dt);
+      chk_err(ierr);
+    }
+    entry->dt = dt;
+    entry->base_type = base_type;
+    entry->rank = rank;
+    entry->hash = hash;
+    entry->last_use = ++datatype_cache_tick;
+    memcpy(entry->extent, extent, rank * sizeof(ptrdiff_t));
+    memcpy(entry->stride, stride, rank * sizeof(ptrdiff_t));
+  }
+  return dt;
+}
+
+/* Release a datatype returned by create_section_type() or hvector_type(),
+ * unless it is owned by the cache. */
+static void
+release_section_type(MPI_Datatype *dt)
+{
+  int i, ierr;
+
+  for (i = 0; i < datatype_cache_size; ++i)
+    if (datatype_cache[i].dt == *dt)
+      return;
+  ierr = MPI_Type_free(dt);
+  chk_err(ierr);
+}
+
+/* Return the committed datatype selecting the size elements of type
+ * base_type, that desc of rank rank describes, relative to the start of its
+ * data.  With a vector subscript in the first dimension an indexed type is
+ * needed.  Else the type is a nest of hvectors, see hvector_type().  A scalar
+ * is repeated size times.  Release the type with release_section_type(). */
+static MPI_Datatype
+create_section_type(gfc_descriptor_t *desc, int rank, caf_vector_t *vector,
+                    size_t size, MPI_Datatype base_type)
+{
+  ptrdiff_t extent[GFC_MAX_DIMENSIONS], stride[GFC_MAX_DIMENSIONS];
+  MPI_Datatype dt;
+  int ierr, j;
+
+  if (vector == NULL)
+  {
+    if (rank == 0)
+      return hvector_type(base_type, 1, (ptrdiff_t[]){size}, (ptrdiff_t[]){0});
+    for (j = 0; j < rank; ++j)
+    {
+      extent[j] = GFC_DESCRIPTOR_EXTENT(desc, j);
+      stride[j] = desc->dim[j]._stride;
+    }
+    return hvector_type(base_type, rank, extent, stride);
+  }
+
+  int *dsp = malloc(size * sizeof(int));
+  size_t i;
+
+  dprint("Setting up strided vector index.\n");
+#define KINDCASE(kind, type)                                                   \
+  case kind:                                                                   \
+    for (i = 0; i < size; ++i)                                                 \
+      dsp[i] = ((ptrdiff_t)((type *)vector->u.v.vector)[i]                     \
+                - desc->dim[0].lower_bound)                                    \
+               * desc->dim[0]._stride;                                         \
+    break
+  switch (vector->u.v.kind)
+  {
+    KINDCASE(1, int8_t);
+    KINDCASE(2, int16_t);
+    KINDCASE(4, int32_t);
+    KINDCASE(8, int64_t);
+#ifdef HAVE_GFC_INTEGER_16
+    KINDCASE(16, __int128);
+#endif
+    default:
+      caf_runtime_error(unreachable);
+  }
+#undef KINDCASE
+  ierr = MPI_Type_create_indexed_block(size, 1, dsp, base_type, &dt);
+  chk_err(ierr);
+  free(dsp);
+  ierr = MPI_Type_commit(&dt);
+  chk_err(ierr);
+  return dt;
+}
+#endif // STRIDED
+
+#ifdef WITH_COMM_THREAD
+/* Set [*lo, *hi) to the bytes spanned by the section of rank dimensions with
+ * the extents and byte strides in dims relative to its first element of
+ * elem_size bytes. */
+static void
+section_span(size_t elem_size, int rank, const ptrdiff_t *dims, ptrdiff_t *lo,
+             ptrdiff_t *hi)
+{
+  int j;
+
+  *lo = 0;
+  *hi = elem_size;
+  for (j = 0; j < rank; ++j)
+  {
+    const ptrdiff_t d = (dims[j] - 1) * dims[rank + j];
+
+    if (dims[j] <= 0)
+      continue;
+    if (d < 0)
+      *lo += d;
+    else
+      *hi += d;
+  }
+}
+
+/* Transfer the size elements of elem_size bytes of the section src at
+ * src_disp on image src_rank to the section dest at dst_disp on dst_rank
+ * without staging them through this image.  The communication thread of
+ * src_rank puts them directly and acknowledges the completion.  Only possible,
+ * when both coarrays are on the symmetric heap, whose window spans the initial
+ * team like ct_COMM, and the windows are locked by lock_all.  The ranks are
+ * the ones in the initial team.  Returns false, when not possible. */
+static bool
+sendget_third_party(caf_token_t token_s, MPI_Aint dst_disp, int dst_rank,
+                    gfc_descriptor_t *dest, caf_token_t token_g,
+                    MPI_Aint src_disp, int src_rank, gfc_descriptor_t *src,
+                    size_t elem_size, size_t size, int *stat)
+{
+  const int src_dims = MAX(GFC_DESCRIPTOR_RANK(src), 1),
+            dst_dims = GFC_DESCRIPTOR_RANK(dest);
+  const size_t msg_size = sizeof(ct_msg_t) + sizeof(struct sendget_msg_data_t)
+                          + 2 * (src_dims + dst_dims) * sizeof(ptrdiff_t);
+  struct sendget_msg_data_t *smd;
+  ct_msg_t *msg;
+  ptrdiff_t *dims;
+  char c;
+  int ierr, j;
+
+  if (!commthread_started || !caf_epoch_lock_all
+      || *TOKEN(token_g) != symmetric_heap_win
+      || *TOKEN(token_s) != symmetric_heap_win)
+    return false;
+
+  msg = alloca(msg_size);
+  memset(msg, 0, sizeof(ct_msg_t));
+  msg->cmd = remote_command_sendget;
+  msg->transfer_size = elem_size;
+  msg->win = MPI_WIN_NULL;
+  msg->win_disp = src_disp;
+  msg->dest_image = dst_rank;
+  msg->dest_tag = CAF_CT_TAG + 1;
+  smd = (struct sendget_msg_data_t *)msg->data;
+  smd->dst_disp = dst_disp;
+  smd->src_rank = src_dims;
+  smd->dst_rank = dst_dims;
+  dims = smd->dims;
+  if (GFC_DESCRIPTOR_RANK(src) == 0)
+  {
+    /* A scalar is replicated to all elements of dest. */
+    dims[0] = size;
+    dims[1] = 0;
+  }
+  else
+    for (j = 0; j < src_dims; ++j)
+    {
+      dims[j] = GFC_DESCRIPTOR_EXTENT(src, j);
+      dims[src_dims + j] = src->dim[j]._stride * elem_size;
+    }
+  dims += 2 * src_dims;
+  for (j = 0; j < dst_dims; ++j)
+  {
+    dims[j] = GFC_DESCRIPTOR_EXTENT(dest, j);
+    dims[dst_dims + j] = dest->dim[j]._stride * elem_size;
+  }
+
+  /* The single put of the communication thread must not read memory it
+   * writes.  Overlapping sections are staged through this image instead. */
+  if (src_rank == dst_rank)
+  {
+    ptrdiff_t src_lo, src_hi, dst_lo, dst_hi;
+
+    section_span(elem_size, src_dims, smd->dims, &src_lo, &src_hi);
+    section_span(elem_size, dst_dims, dims, &dst_lo, &dst_hi);
+    if (src_disp + src_lo < dst_disp + dst_hi
+        && dst_disp + dst_lo < src_disp + src_hi)
+      return false;
+  }
+
+  /* The transfer has to see this image's puts to the source and must not be
+   * overtaken by the ones to the destination. */
+  ierr = pending_puts_complete(symmetric_heap_win, src_rank);
+  chk_err(ierr);
+  ierr = pending_puts_complete(symmetric_heap_win, dst_rank);
+  chk_err(ierr);
+  shared_memory_fence();
+
+  dprint("Delegating sendget of %zd elements to image %d.\n", size,
+         src_rank + 1);
+  ierr = ct_send(msg, msg_size, src_rank);
+  chk_err(ierr);
+  ierr = MPI_Recv(&c, 1, MPI_BYTE, src_rank, msg->dest_tag, CAF_COMM_WORLD,
+                  MPI_STATUS_IGNORE);
+  chk_err(ierr);
+  if (stat)
+    *stat = c;
+  else if (c)
+    caf_runtime_error("Third party transfer on image %d failed", src_rank + 1);
+  return true;
+}
+#endif
+
 void
 PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
                 gfc_descriptor_t *dest, caf_vector_t *dst_vector,
@@ -2858,37 +6090,14 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
       dst_remote_image = image_index_s - 1;
 
   if (!src_same_image)
-  {
-    MPI_Group current_team_group, win_group;
-    ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Win_get_group(*p, &win_group);
-    chk_err(ierr);
-    ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                     (int[]){src_remote_image}, win_group,
-                                     &src_remote_image);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&win_group);
-    chk_err(ierr);
-  }
+    src_remote_image = win_rank(TOKEN_WIN_RANKS(token_g), src_remote_image);
   if (!dst_same_image)
-  {
-    MPI_Group current_team_group, win_group;
-    ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Win_get_group(*p, &win_group);
-    chk_err(ierr);
-    ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                     (int[]){dst_remote_image}, win_group,
-                                     &dst_remote_image);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&win_group);
-    chk_err(ierr);
-  }
+    dst_remote_image = win_rank(TOKEN_WIN_RANKS(token_g), dst_remote_image);
+  read_cache_write(token_s);
+
+  /* Make the offsets relative to the start of the windows. */
+  offset_g += TOKEN_DISP(token_g);
+  offset_s += TOKEN_DISP(token_s);
 
   /* Ensure stat is always set. */
 #ifdef GCC_GE_7
@@ -2919,20 +6128,22 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
   check_image_health(image_index_g, stat);
   check_image_health(image_index_s, stat);
 
+#ifdef WITH_COMM_THREAD
+  if (!src_same_image && !dst_same_image && same_type_and_kind
+      && src_size == dst_size && src_vector == NULL && dst_vector == NULL
+      && sendget_third_party(token_s, offset_s, dst_remote_image, dest,
+                             token_g, offset_g, src_remote_image, src,
+                             src_size, size, stat))
+    return;
+#endif
+
   /* For char arrays: create the padding array, when dst is longer than src. */
   if (dest_char_array_is_longer)
   {
     const size_t pad_num = (dst_size / dst_kind) - (src_size / src_kind);
     const size_t pad_sz = pad_num * dst_kind;
-    /* For big arrays alloca() may not be able to get the memory on the stack.
-     * Use a regular malloc then. */
-    if ((free_pad_str = ((pad_str = alloca(pad_sz)) == NULL)))
-    {
-      pad_str = malloc(pad_sz);
-      if (src_t_buff == NULL)
-        caf_runtime_error("Unable to allocate memory "
-                          "for internal buffer in sendget().");
-    }
+    pad_str = bounce_alloc(pad_sz);
+    free_pad_str = true;
     if (dst_kind == 1)
     {
       memset(pad_str, ' ', pad_num);
@@ -2963,14 +6174,8 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
       else
       {
         dprint("allocating %zd bytes for dst_t_buff.\n", dst_size * size);
-        if ((free_dst_t_buff
-             = ((dst_t_buff = alloca(dst_size * size)) == NULL)))
-        {
-          dst_t_buff = malloc(dst_size * size);
-          if (dst_t_buff == NULL)
-            caf_runtime_error("Unable to allocate memory "
-                              "for internal buffer in sendget().");
-        }
+        dst_t_buff = bounce_alloc(dst_size * size);
+        free_dst_t_buff = true;
         if (dst_type == BT_CHARACTER)
         {
           /* The size is encoded in the descriptor's type for char arrays. */
@@ -2990,29 +6195,9 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
     {
       /* When replication is needed, only access the scalar on the remote. */
       const size_t src_real_size = src_rank > 0 ? (src_size * size) : src_size;
-      if ((free_dst_t_buff = ((dst_t_buff = alloca(dst_size * size)) == NULL)))
-      {
-        dst_t_buff = malloc(dst_size * size);
-        if (dst_t_buff == NULL)
-          caf_runtime_error("Unable to allocate memory "
-                            "for internal buffer in sendget().");
-      }
-
-      if (dst_kind != src_kind || src_rank == 0 || dest_char_array_is_longer)
-      {
-        if ((free_src_t_buff
-             = ((src_t_buff = alloca(src_size * size)) == NULL)))
-        {
-          src_t_buff = malloc(src_size * size);
-          if (src_t_buff == NULL)
-            caf_runtime_error("Unable to allocate memory "
-                              "for internal buffer in sendget().");
-        }
-      }
-      else
-        src_t_buff = dst_t_buff;
+      dst_t_buff = bounce_alloc(dst_size * size);
+      free_dst_t_buff = true;
 
-      CAF_Win_lock(MPI_LOCK_SHARED, src_remote_image, *p);
       if ((same_type_and_kind && dst_rank == src_rank)
           || dst_type == BT_CHARACTER)
       {
@@ -3021,170 +6206,57 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
         {
           const size_t trans_size
               = ((dst_size > src_size) ? src_size : dst_size) * size;
-          ierr = MPI_Get(dst_t_buff, trans_size, MPI_BYTE, src_remote_image,
-                         offset_g, trans_size, MPI_BYTE, *p);
+          ierr = get_bytes(token_g, *p, src_remote_image, offset_g, dst_t_buff,
+                           trans_size);
           chk_err(ierr);
         }
         else
         {
-          ierr = MPI_Get(src_t_buff, src_real_size, MPI_BYTE, src_remote_image,
-                         offset_g, src_real_size, MPI_BYTE, *p);
+          src_t_buff = bounce_alloc(src_size * size);
+          free_src_t_buff = true;
+          ierr = get_bytes(token_g, *p, src_remote_image, offset_g, src_t_buff,
+                           src_real_size);
           chk_err(ierr);
           dprint("copy_char_to_self(src_size = %zd, src_kind = %d, "
                  "dst_size = %zd, dst_kind = %d, size = %zd)\n",
-                 src_size, src_kind, dst_size, dst_kind, size);
-          copy_char_to_self(src_t_buff, src_type, src_size, src_kind,
-                            dst_t_buff, dst_type, dst_size, dst_kind, size,
-                            src_rank == 0);
-          dprint("|%s|\n", (char *)dst_t_buff);
-        }
-      }
-      else
-      {
-        ierr = MPI_Get(src_t_buff, src_real_size, MPI_BYTE, src_remote_image,
-                       offset_g, src_real_size, MPI_BYTE, *p);
-        chk_err(ierr);
-        convert_with_strides(dst_t_buff, dst_type, dst_kind, dst_size,
-                             src_t_buff, src_type, src_kind,
-                             (src_rank > 0) ? src_size : 0, size, stat);
-      }
-      CAF_Win_unlock(src_remote_image, *p);
-    }
-  }
-#ifdef STRIDED
-  else if (!src_same_image && same_type_and_kind && dst_type != BT_CHARACTER)
-  {
-    /* For strided copy, no type and kind conversion, copy to self or
-     * character arrays are supported. */
-    MPI_Datatype dt_s, dt_d, base_type_src, base_type_dst;
-    int *arr_bl;
-    int *arr_dsp_s;
-
-    if ((free_dst_t_buff = ((dst_t_buff = alloca(dst_size * size)) == NULL)))
-    {
-      dst_t_buff = malloc(dst_size * size);
-      if (dst_t_buff == NULL)
-        caf_runtime_error("Unable to allocate memory "
-                          "for internal buffer in sendget().");
-    }
-
-    selectType(src_size, &base_type_src);
-    selectType(dst_size, &base_type_dst);
-
-    if (src_rank == 1)
-    {
-      if (src_vector == NULL)
-      {
-        ierr = MPI_Type_vector(size, 1, src->dim[0]._stride, base_type_src,
-                               &dt_s);
-        chk_err(ierr);
-      }
-      else
-      {
-        arr_bl = calloc(size, sizeof(int));
-        arr_dsp_s = calloc(size, sizeof(int));
-
-        dprint("Setting up strided vector index.\n");
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    for (i = 0; i < size; ++i)                                                 \
-    {                                                                          \
-      arr_dsp_s[i] = ((ptrdiff_t)((type *)src_vector->u.v.vector)[i]           \
-                      - src->dim[0].lower_bound);                              \
-      arr_bl[i] = 1;                                                           \
-    }                                                                          \
-    break
-
-        switch (src_vector->u.v.kind)
-        {
-          KINDCASE(1, int8_t);
-          KINDCASE(2, int16_t);
-          KINDCASE(4, int32_t);
-          KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-          KINDCASE(16, __int128);
-#endif
-          default:
-            caf_runtime_error(unreachable);
-            return;
-        }
-#undef KINDCASE
-        ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_s, base_type_src, &dt_s);
-        chk_err(ierr);
-        free(arr_bl);
-        free(arr_dsp_s);
-      }
-      ierr = MPI_Type_vector(size, 1, 1, base_type_dst, &dt_d);
-      chk_err(ierr);
-    }
-    else
-    {
-      arr_bl = calloc(size, sizeof(int));
-      arr_dsp_s = calloc(size, sizeof(int));
-
-      for (i = 0; i < size; ++i)
-      {
-        arr_bl[i] = 1;
-      }
-
-      for (i = 0; i < size; ++i)
-      {
-        ptrdiff_t array_offset_sr = 0, extent = 1, tot_ext = 1;
-        if (src_vector == NULL)
-        {
-          for (j = 0; j < src_rank - 1; ++j)
-          {
-            extent = src->dim[j]._ubound - src->dim[j].lower_bound + 1;
-            array_offset_sr += ((i / tot_ext) % extent) * src->dim[j]._stride;
-            tot_ext *= extent;
-          }
-
-          array_offset_sr += (i / tot_ext) * src->dim[src_rank - 1]._stride;
-        }
-        else
-        {
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    array_offset_sr = ((ptrdiff_t)((type *)src_vector->u.v.vector)[i]          \
-                       - src->dim[0].lower_bound);                             \
-    break
-          switch (src_vector->u.v.kind)
-          {
-            KINDCASE(1, int8_t);
-            KINDCASE(2, int16_t);
-            KINDCASE(4, int32_t);
-            KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-            KINDCASE(16, __int128);
-#endif
-            default:
-              caf_runtime_error(unreachable);
-              return;
-          }
-#undef KINDCASE
+                 src_size, src_kind, dst_size, dst_kind, size);
+          copy_char_to_self(src_t_buff, src_type, src_size, src_kind,
+                            dst_t_buff, dst_type, dst_size, dst_kind, size,
+                            src_rank == 0);
+          dprint("|%s|\n", (char *)dst_t_buff);
         }
-        arr_dsp_s[i] = array_offset_sr;
       }
+      else
+      {
+        ierr = get_converted(token_g, *p, src_remote_image, offset_g,
+                             dst_t_buff, dst_type, dst_kind, dst_size, src_type,
+                             src_kind, src_size, src_rank == 0, size, stat);
+        chk_err(ierr);
+      }
+    }
+  }
+#ifdef STRIDED
+  else if (!src_same_image && same_type_and_kind && dst_type != BT_CHARACTER)
+  {
+    /* For strided copy, no type and kind conversion, copy to self or
+     * character arrays are supported. */
+    MPI_Datatype dt_s, dt_d, base_type_src, base_type_dst;
 
-      ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_s, base_type_src, &dt_s);
-      chk_err(ierr);
-      ierr = MPI_Type_vector(size, 1, 1, base_type_dst, &dt_d);
-      chk_err(ierr);
+    dst_t_buff = bounce_alloc(dst_size * size);
+    free_dst_t_buff = true;
 
-      free(arr_bl);
-      free(arr_dsp_s);
-    }
+    selectType(src_size, &base_type_src);
+    selectType(dst_size, &base_type_dst);
 
-    ierr = MPI_Type_commit(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_commit(&dt_d);
-    chk_err(ierr);
+    dt_s = create_section_type(src, src_rank, src_vector, size, base_type_src);
+    dt_d = hvector_type(base_type_dst, 1, (ptrdiff_t[]){size},
+                        (ptrdiff_t[]){1});
 
     CAF_Win_lock(MPI_LOCK_SHARED, src_remote_image, *p);
     ierr
         = MPI_Get(dst_t_buff, 1, dt_d, src_remote_image, offset_g, 1, dt_s, *p);
     chk_err(ierr);
-    CAF_Win_unlock(src_remote_image, *p);
+    CAF_Win_unlock_local(src_remote_image, *p);
 
 #ifdef WITH_FAILED_IMAGES
     check_image_health(image_index_g, stat);
@@ -3201,33 +6273,21 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
       return;
     }
 #endif
-    ierr = MPI_Type_free(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_free(&dt_d);
-    chk_err(ierr);
+    release_section_type(&dt_s);
+    release_section_type(&dt_d);
   }
 #endif // STRIDED
   else
   {
-    if ((free_dst_t_buff = ((dst_t_buff = alloca(dst_size * size)) == NULL)))
-    {
-      dst_t_buff = malloc(dst_size * size);
-      if (dst_t_buff == NULL)
-        caf_runtime_error("Unable to allocate memory "
-                          "for internal buffer in sendget().");
-    }
+    dst_t_buff = bounce_alloc(dst_size * size);
+    free_dst_t_buff = true;
 
     if (src_same_image)
       src_t_buff = src->base_addr;
     else if (!same_type_and_kind)
     {
-      if ((free_src_t_buff = (((src_t_buff = alloca(src_size))) == NULL)))
-      {
-        src_t_buff = malloc(src_size);
-        if (src_t_buff == NULL)
-          caf_runtime_error("Unable to allocate memory "
-                            "for internal buffer in sendget().");
-      }
+      src_t_buff = bounce_alloc(src_size);
+      free_src_t_buff = true;
     }
 
     if (!src_same_image)
@@ -3338,7 +6398,7 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
 #endif
     }
     if (!src_same_image)
-      CAF_Win_unlock(src_remote_image, *p);
+      CAF_Win_unlock_local(src_remote_image, *p);
   }
 
   p = TOKEN(token_s);
@@ -3349,33 +6409,9 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
       memmove(dest->base_addr, dst_t_buff, dst_size * size);
     else
     {
-      CAF_Win_lock(MPI_LOCK_EXCLUSIVE, dst_remote_image, *p);
-      const size_t trans_size = size * dst_size;
-      ierr = MPI_Put(dst_t_buff, trans_size, MPI_BYTE, dst_remote_image,
-                     offset_s, trans_size, MPI_BYTE, *p);
+      ierr = put_bytes(token_s, *p, dst_remote_image, offset_s, dst_t_buff,
+                       size * dst_size);
       chk_err(ierr);
-      ierr = CAF_Win_unlock(dst_remote_image, *p);
-      chk_err(ierr);
-#if NONBLOCKING_PUT
-      /* Pending puts init */
-      if (pending_puts == NULL)
-      {
-        pending_puts = calloc(1, sizeof(win_sync));
-        pending_puts->next = NULL;
-        pending_puts->win = token_s;
-        pending_puts->img = dst_remote_image;
-        last_elem = pending_puts;
-        last_elem->next = NULL;
-      }
-      else
-      {
-        last_elem->next = calloc(1, sizeof(win_sync));
-        last_elem = last_elem->next;
-        last_elem->win = token_s;
-        last_elem->img = dst_remote_image;
-        last_elem->next = NULL;
-      }
-#endif // CAF_MPI_LOCK_UNLOCK
     }
   }
 #ifdef STRIDED
@@ -3384,117 +6420,12 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
     /* For strided copy, no type and kind conversion, copy to self or
      * character arrays are supported. */
     MPI_Datatype dt_s, dt_d, base_type_dst;
-    int *arr_bl, *arr_dsp_d;
 
     selectType(dst_size, &base_type_dst);
 
-    if (dst_rank == 1)
-    {
-      if (dst_vector == NULL)
-      {
-        ierr = MPI_Type_vector(size, 1, dest->dim[0]._stride, base_type_dst,
-                               &dt_d);
-        chk_err(ierr);
-      }
-      else
-      {
-        arr_bl = calloc(size, sizeof(int));
-        arr_dsp_d = calloc(size, sizeof(int));
-
-        dprint("Setting up strided vector index.\n");
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    for (i = 0; i < size; ++i)                                                 \
-    {                                                                          \
-      arr_dsp_d[i] = ((ptrdiff_t)((type *)dst_vector->u.v.vector)[i]           \
-                      - dest->dim[0].lower_bound);                             \
-      arr_bl[i] = 1;                                                           \
-    }                                                                          \
-    break
-        switch (dst_vector->u.v.kind)
-        {
-          KINDCASE(1, int8_t);
-          KINDCASE(2, int16_t);
-          KINDCASE(4, int32_t);
-          KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-          KINDCASE(16, __int128);
-#endif
-          default:
-            caf_runtime_error(unreachable);
-            return;
-        }
-#undef KINDCASE
-        ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_d, base_type_dst, &dt_d);
-        chk_err(ierr);
-        free(arr_bl);
-        free(arr_dsp_d);
-      }
-      ierr = MPI_Type_vector(size, 1, 1, base_type_dst, &dt_s);
-      chk_err(ierr);
-    }
-    else
-    {
-      arr_bl = calloc(size, sizeof(int));
-      arr_dsp_d = calloc(size, sizeof(int));
-
-      for (i = 0; i < size; ++i)
-      {
-        arr_bl[i] = 1;
-      }
-
-      for (i = 0; i < size; ++i)
-      {
-        ptrdiff_t array_offset_dst = 0, extent = 1, tot_ext = 1;
-        if (dst_vector == NULL)
-        {
-          for (j = 0; j < dst_rank - 1; ++j)
-          {
-            extent = dest->dim[j]._ubound - dest->dim[j].lower_bound + 1;
-            array_offset_dst += ((i / tot_ext) % extent) * dest->dim[j]._stride;
-            tot_ext *= extent;
-          }
-
-          array_offset_dst += (i / tot_ext) * dest->dim[dst_rank - 1]._stride;
-        }
-        else
-        {
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    array_offset_dst = ((ptrdiff_t)((type *)dst_vector->u.v.vector)[i]         \
-                        - dest->dim[0].lower_bound);                           \
-    break
-          switch (dst_vector->u.v.kind)
-          {
-            KINDCASE(1, int8_t);
-            KINDCASE(2, int16_t);
-            KINDCASE(4, int32_t);
-            KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-            KINDCASE(16, __int128);
-#endif
-            default:
-              caf_runtime_error(unreachable);
-              return;
-          }
-#undef KINDCASE
-        }
-        arr_dsp_d[i] = array_offset_dst;
-      }
-
-      ierr = MPI_Type_vector(size, 1, 1, base_type_dst, &dt_s);
-      chk_err(ierr);
-      ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_d, base_type_dst, &dt_d);
-      chk_err(ierr);
-
-      free(arr_bl);
-      free(arr_dsp_d);
-    }
-
-    ierr = MPI_Type_commit(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_commit(&dt_d);
-    chk_err(ierr);
+    dt_s = hvector_type(base_type_dst, 1, (ptrdiff_t[]){size},
+                        (ptrdiff_t[]){1});
+    dt_d = create_section_type(dest, dst_rank, dst_vector, size, base_type_dst);
 
     CAF_Win_lock(MPI_LOCK_EXCLUSIVE, dst_remote_image, *p);
     ierr
@@ -3517,10 +6448,8 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
       return;
     }
 #endif
-    ierr = MPI_Type_free(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_free(&dt_d);
-    chk_err(ierr);
+    release_section_type(&dt_s);
+    release_section_type(&dt_d);
   }
 #endif // STRIDED
   else
@@ -3589,13 +6518,13 @@ PREFIX(sendget)(caf_token_t token_s, size_t offset_s, int image_index_s,
       CAF_Win_unlock(dst_remote_image, *p);
   }
 
-  /* Free memory, when not allocated on stack. */
+  /* Return the staging buffers. */
   if (free_src_t_buff)
-    free(src_t_buff);
+    bounce_release(src_t_buff);
   if (free_dst_t_buff)
-    free(dst_t_buff);
+    bounce_release(dst_t_buff);
   if (free_pad_str)
-    free(pad_str);
+    bounce_release(pad_str);
 
 #ifdef WITH_FAILED_IMAGES
   /* Catch failed images, when failed image support is active. */
@@ -3651,20 +6580,11 @@ PREFIX(send)(caf_token_t token, size_t offset, int image_index,
       = dst_type == BT_CHARACTER && dst_size > src_size && !same_image;
   int remote_image = image_index - 1;
   if (!same_image)
-  {
-    MPI_Group current_team_group, win_group;
-    ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Win_get_group(*p, &win_group);
-    chk_err(ierr);
-    ierr = MPI_Group_translate_ranks(
-        current_team_group, 1, (int[]){remote_image}, win_group, &remote_image);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&win_group);
-    chk_err(ierr);
-  }
+    remote_image = win_rank(TOKEN_WIN_RANKS(token), remote_image);
+  read_cache_write(token);
+
+  /* Make the offset relative to the start of the window. */
+  offset += TOKEN_DISP(token);
 
   /* Ensure stat is always set. */
 #ifdef GCC_GE_7
@@ -3697,15 +6617,8 @@ PREFIX(send)(caf_token_t token, size_t offset, int image_index,
   {
     const size_t pad_num = (dst_size / dst_kind) - (src_size / src_kind);
     const size_t pad_sz = pad_num * dst_kind;
-    /* For big arrays alloca() may not be able to get the memory on the stack.
-     * Use a regular malloc then. */
-    if ((free_pad_str = ((pad_str = alloca(pad_sz)) == NULL)))
-    {
-      pad_str = malloc(pad_sz);
-      if (t_buff == NULL)
-        caf_runtime_error("Unable to allocate memory "
-                          "for internal buffer in send().");
-    }
+    pad_str = bounce_alloc(pad_sz);
+    free_pad_str = true;
     if (dst_kind == 1)
       memset(pad_str, ' ', pad_num);
     else /* dst_kind == 4. */
@@ -3733,222 +6646,58 @@ PREFIX(send)(caf_token_t token, size_t offset, int image_index,
                           src_rank == 0);
       else
         copy_to_self(src, src_kind, dest, dst_kind, size, stat);
+      if (free_pad_str)
+        bounce_release(pad_str);
       return;
     }
     else
     {
-      if (dst_kind != src_kind || dest_char_array_is_longer || src_rank == 0)
-      {
-        if ((free_t_buff = ((t_buff = alloca(dst_size * size)) == NULL)))
-        {
-          t_buff = malloc(dst_size * size);
-          if (t_buff == NULL)
-            caf_runtime_error("Unable to allocate memory "
-                              "for internal buffer in send().");
-        }
-      }
-
-      if ((same_type_and_kind && dst_rank == src_rank)
-          || dst_type == BT_CHARACTER)
-      {
-        if (dest_char_array_is_longer
-            || (dst_kind != src_kind && dst_type == BT_CHARACTER))
-        {
-          copy_char_to_self(src->base_addr, src_type, src_size, src_kind,
-                            t_buff, dst_type, dst_size, dst_kind, size,
-                            src_rank == 0);
-          CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
-          ierr = MPI_Put(t_buff, dst_size, MPI_BYTE, remote_image, offset,
-                         dst_size, MPI_BYTE, *p);
-          chk_err(ierr);
-          CAF_Win_unlock(remote_image, *p);
-        }
-        else
-        {
-          const size_t trans_size
-              = ((dst_size > src_size) ? src_size : dst_size) * size;
-          CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
-          ierr = MPI_Put(src->base_addr, trans_size, MPI_BYTE, remote_image,
-                         offset, trans_size, MPI_BYTE, *p);
-          chk_err(ierr);
-          CAF_Win_unlock(remote_image, *p);
-        }
-      }
-      else
-      {
-        convert_with_strides(t_buff, dst_type, dst_kind, dst_size,
-                             src->base_addr, src_type, src_kind,
-                             (src_rank > 0) ? src_size : 0, size, stat);
-        CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
-        ierr = MPI_Put(t_buff, dst_size * size, MPI_BYTE, remote_image, offset,
-                       dst_size * size, MPI_BYTE, *p);
-        chk_err(ierr);
-        ierr = CAF_Win_unlock(remote_image, *p);
-        chk_err(ierr);
-      }
-#if NONBLOCKING_PUT
-      /* Pending puts init */
-      if (pending_puts == NULL)
-      {
-        pending_puts = calloc(1, sizeof(win_sync));
-        pending_puts->next = NULL;
-        pending_puts->win = token;
-        pending_puts->img = remote_image;
-        last_elem = pending_puts;
-        last_elem->next = NULL;
-      }
-      else
-      {
-        last_elem->next = calloc(1, sizeof(win_sync));
-        last_elem = last_elem->next;
-        last_elem->win = token;
-        last_elem->img = remote_image;
-        last_elem->next = NULL;
-      }
-#endif // CAF_MPI_LOCK_UNLOCK
-    }
-  }
-
-#ifdef STRIDED
-  else if (!same_image && same_type_and_kind && dst_type != BT_CHARACTER)
-  {
-    /* For strided copy, no type and kind conversion, copy to self or
-     * character arrays are supported. */
-    MPI_Datatype dt_s, dt_d, base_type_src, base_type_dst;
-    int *arr_bl, *arr_dsp_s, *arr_dsp_d;
-
-    selectType(src_size, &base_type_src);
-    selectType(dst_size, &base_type_dst);
-
-    if (dst_rank == 1)
-    {
-      if (dst_vector == NULL)
-      {
-        dprint("Setting up mpi datatype vector with "
-               "stride %d, size %d and offset %d.\n",
-               dest->dim[0]._stride, size, offset);
-        ierr = MPI_Type_vector(size, 1, dest->dim[0]._stride, base_type_dst,
-                               &dt_d);
-        chk_err(ierr);
-      }
-      else
-      {
-        arr_bl = calloc(size, sizeof(int));
-        arr_dsp_d = calloc(size, sizeof(int));
-
-        dprint("Setting up strided vector index.\n");
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    for (i = 0; i < size; ++i)                                                 \
-    {                                                                          \
-      arr_dsp_d[i] = ((ptrdiff_t)((type *)dst_vector->u.v.vector)[i]           \
-                      - dest->dim[0].lower_bound);                             \
-      arr_bl[i] = 1;                                                           \
-    }                                                                          \
-    break
-        switch (dst_vector->u.v.kind)
-        {
-          KINDCASE(1, int8_t);
-          KINDCASE(2, int16_t);
-          KINDCASE(4, int32_t);
-          KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-          KINDCASE(16, __int128);
-#endif
-          default:
-            caf_runtime_error(unreachable);
-            return;
-        }
-#undef KINDCASE
-        ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_d, base_type_dst, &dt_d);
-        chk_err(ierr);
-        free(arr_bl);
-        free(arr_dsp_d);
-      }
-      MPI_Type_vector(size, 1, src->dim[0]._stride, base_type_src, &dt_s);
-    }
-    else
-    {
-      arr_bl = calloc(size, sizeof(int));
-      arr_dsp_s = calloc(size, sizeof(int));
-      arr_dsp_d = calloc(size, sizeof(int));
-
-      for (i = 0; i < size; ++i)
-      {
-        arr_bl[i] = 1;
-      }
-
-      for (i = 0; i < size; ++i)
-      {
-        ptrdiff_t array_offset_dst = 0, extent = 1, tot_ext = 1;
-        if (dst_vector == NULL)
-        {
-          for (j = 0; j < dst_rank - 1; ++j)
-          {
-            extent = dest->dim[j]._ubound - dest->dim[j].lower_bound + 1;
-            array_offset_dst += ((i / tot_ext) % extent) * dest->dim[j]._stride;
-            tot_ext *= extent;
-          }
-
-          array_offset_dst += (i / tot_ext) * dest->dim[dst_rank - 1]._stride;
-        }
-        else
-        {
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    array_offset_dst = ((ptrdiff_t)((type *)dst_vector->u.v.vector)[i]         \
-                        - dest->dim[0].lower_bound);                           \
-    break
-          switch (dst_vector->u.v.kind)
-          {
-            KINDCASE(1, int8_t);
-            KINDCASE(2, int16_t);
-            KINDCASE(4, int32_t);
-            KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-            KINDCASE(16, __int128);
-#endif
-            default:
-              caf_runtime_error(unreachable);
-              return;
-          }
-#undef KINDCASE
-        }
-        arr_dsp_d[i] = array_offset_dst;
-
-        if (src_rank != 0)
+      if ((same_type_and_kind && dst_rank == src_rank)
+          || dst_type == BT_CHARACTER)
+      {
+        if (dest_char_array_is_longer
+            || (dst_kind != src_kind && dst_type == BT_CHARACTER))
         {
-          ptrdiff_t array_offset_sr = 0;
-          extent = 1;
-          tot_ext = 1;
-          for (j = 0; j < src_rank - 1; ++j)
-          {
-            extent = src->dim[j]._ubound - src->dim[j].lower_bound + 1;
-            array_offset_sr += ((i / tot_ext) % extent) * src->dim[j]._stride;
-            tot_ext *= extent;
-          }
-
-          array_offset_sr += (i / tot_ext) * src->dim[src_rank - 1]._stride;
-          arr_dsp_s[i] = array_offset_sr;
+          t_buff = bounce_alloc(dst_size * size);
+          free_t_buff = true;
+          copy_char_to_self(src->base_addr, src_type, src_size, src_kind,
+                            t_buff, dst_type, dst_size, dst_kind, size,
+                            src_rank == 0);
+          ierr = put_bytes(token, *p, remote_image, offset, t_buff, dst_size);
+          chk_err(ierr);
         }
         else
-          arr_dsp_s[i] = 0;
+        {
+          const size_t trans_size
+              = ((dst_size > src_size) ? src_size : dst_size) * size;
+          ierr = put_bytes(token, *p, remote_image, offset, src->base_addr,
+                           trans_size);
+          chk_err(ierr);
+        }
+      }
+      else
+      {
+        ierr = put_converted(token, *p, remote_image, offset, dst_type,
+                             dst_kind, dst_size, src->base_addr, src_type,
+                             src_kind, (src_rank > 0) ? src_size : 0, size,
+                             stat);
+        chk_err(ierr);
       }
+    }
+  }
 
-      ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_s, base_type_src, &dt_s);
-      chk_err(ierr);
-      ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_d, base_type_dst, &dt_d);
-      chk_err(ierr);
+#ifdef STRIDED
+  else if (!same_image && same_type_and_kind && dst_type != BT_CHARACTER)
+  {
+    /* For strided copy, no type and kind conversion, copy to self or
+     * character arrays are supported. */
+    MPI_Datatype dt_s, dt_d, base_type_src, base_type_dst;
 
-      free(arr_bl);
-      free(arr_dsp_s);
-      free(arr_dsp_d);
-    }
+    selectType(src_size, &base_type_src);
+    selectType(dst_size, &base_type_dst);
 
-    ierr = MPI_Type_commit(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_commit(&dt_d);
-    chk_err(ierr);
+    dt_s = create_section_type(src, src_rank, NULL, size, base_type_src);
+    dt_d = create_section_type(dest, dst_rank, dst_vector, size, base_type_dst);
 
     CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
     ierr = MPI_Put(src->base_addr, 1, dt_s, remote_image, offset, 1, dt_d, *p);
@@ -3970,33 +6719,21 @@ PREFIX(send)(caf_token_t token, size_t offset, int image_index,
       return;
     }
 #endif
-    ierr = MPI_Type_free(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_free(&dt_d);
-    chk_err(ierr);
+    release_section_type(&dt_s);
+    release_section_type(&dt_d);
   }
 #endif // STRIDED
   else
   {
     if (same_image && mrt)
     {
-      if ((free_t_buff = (((t_buff = alloca(dst_size * size))) == NULL)))
-      {
-        t_buff = malloc(dst_size * size);
-        if (t_buff == NULL)
-          caf_runtime_error("Unable to allocate memory "
-                            "for internal buffer in send().");
-      }
+      t_buff = bounce_alloc(dst_size * size);
+      free_t_buff = true;
     }
     else if (!same_type_and_kind && !same_image)
     {
-      if ((free_t_buff = (((t_buff = alloca(dst_size))) == NULL)))
-      {
-        t_buff = malloc(dst_size);
-        if (t_buff == NULL)
-          caf_runtime_error("Unable to allocate memory "
-                            "for internal buffer in send().");
-      }
+      t_buff = bounce_alloc(dst_size);
+      free_t_buff = true;
     }
 
     for (i = 0; i < size; ++i)
@@ -4069,37 +6806,44 @@ PREFIX(send)(caf_token_t token, size_t offset, int image_index,
         if (same_type_and_kind)
         {
           const size_t trans_size = (src_size < dst_size) ? src_size : dst_size;
-          CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
-          ierr = MPI_Put(sr, trans_size, MPI_BYTE, remote_image,
-                         offset + dst_offset, trans_size, MPI_BYTE, *p);
-          chk_err(ierr);
-          if (pad_str)
+          char *dst = shared_memory_address(token, remote_image,
+                                            offset + dst_offset);
+          if (dst)
+          {
+            memcpy(dst, sr, trans_size);
+            if (pad_str)
+              memcpy(dst + src_size, pad_str, dst_size - src_size);
+          }
+          else
           {
-            ierr = MPI_Put(pad_str, dst_size - src_size, MPI_BYTE, remote_image,
-                           offset + dst_offset + src_size, dst_size - src_size,
-                           MPI_BYTE, *p);
+            CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
+            ierr = MPI_Put(sr, trans_size, MPI_BYTE, remote_image,
+                           offset + dst_offset, trans_size, MPI_BYTE, *p);
             chk_err(ierr);
+            if (pad_str)
+            {
+              ierr = MPI_Put(pad_str, dst_size - src_size, MPI_BYTE,
+                             remote_image, offset + dst_offset + src_size,
+                             dst_size - src_size, MPI_BYTE, *p);
+              chk_err(ierr);
+            }
+            CAF_Win_unlock(remote_image, *p);
           }
-          CAF_Win_unlock(remote_image, *p);
         }
         else if (dst_type == BT_CHARACTER)
         {
           copy_char_to_self(sr, src_type, src_size, src_kind, t_buff, dst_type,
                             dst_size, dst_kind, 1, true);
-          CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
-          ierr = MPI_Put(t_buff, dst_size, MPI_BYTE, remote_image,
-                         offset + dst_offset, dst_size, MPI_BYTE, *p);
-          CAF_Win_unlock(remote_image, *p);
+          ierr = put_bytes(token, *p, remote_image, offset + dst_offset, t_buff,
+                           dst_size);
           chk_err(ierr);
         }
         else
         {
           convert_type(t_buff, dst_type, dst_kind, sr, src_type, src_kind,
                        stat);
-          CAF_Win_lock(MPI_LOCK_EXCLUSIVE, remote_image, *p);
-          ierr = MPI_Put(t_buff, dst_size, MPI_BYTE, remote_image,
-                         offset + dst_offset, dst_size, MPI_BYTE, *p);
-          CAF_Win_unlock(remote_image, *p);
+          ierr = put_bytes(token, *p, remote_image, offset + dst_offset, t_buff,
+                           dst_size);
           chk_err(ierr);
         }
       }
@@ -4176,11 +6920,11 @@ PREFIX(send)(caf_token_t token, size_t offset, int image_index,
     }
   }
 
-  /* Free memory, when not allocated on stack. */
+  /* Return the staging buffers. */
   if (free_t_buff)
-    free(t_buff);
+    bounce_release(t_buff);
   if (free_pad_str)
-    free(pad_str);
+    bounce_release(pad_str);
 
 #ifdef WITH_FAILED_IMAGES
   /* Catch failed images, when failed image support is active. */
@@ -4235,26 +6979,17 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
 
   if (!same_image)
   {
-    MPI_Group current_team_group, win_group;
-    int trans_ranks[2];
-    ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Win_get_group(*p, &win_group);
-    chk_err(ierr);
-    ierr = MPI_Group_translate_ranks(current_team_group, 2,
-                                     (int[]){remote_image, this_image},
-                                     win_group, trans_ranks);
+    const int *win_ranks = TOKEN_WIN_RANKS(token);
     dprint("rank translation: remote: %d -> %d, this: %d -> %d.\n",
-           remote_image, trans_ranks[0], this_image, trans_ranks[1]);
-    remote_image = trans_ranks[0];
-    this_image = trans_ranks[1];
-    chk_err(ierr);
-    ierr = MPI_Group_free(&current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&win_group);
-    chk_err(ierr);
+           remote_image, win_rank(win_ranks, remote_image), this_image,
+           win_rank(win_ranks, this_image));
+    remote_image = win_rank(win_ranks, remote_image);
+    this_image = win_rank(win_ranks, this_image);
   }
 
+  /* Make the offset relative to the start of the window. */
+  offset += TOKEN_DISP(token);
+
   /* Ensure stat is always set. */
 #ifdef GCC_GE_7
   int *stat = pstat;
@@ -4286,15 +7021,8 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
   {
     const size_t pad_num = (dst_size / dst_kind) - (src_size / src_kind);
     const size_t pad_sz = pad_num * dst_kind;
-    /* For big arrays alloca() may not be able to get the memory on the stack.
-     * Use a regular malloc then. */
-    if ((free_pad_str = ((pad_str = alloca(pad_sz)) == NULL)))
-    {
-      pad_str = malloc(pad_sz);
-      if (t_buff == NULL)
-        caf_runtime_error("Unable to allocate memory "
-                          "for internal buffer in get().");
-    }
+    pad_str = bounce_alloc(pad_sz);
+    free_pad_str = true;
     if (dst_kind == 1)
       memset(pad_str, ' ', pad_num);
     else /* dst_kind == 4. */
@@ -4322,21 +7050,12 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
                           src_rank == 0);
       else
         copy_to_self(src, src_kind, dest, dst_kind, size, stat);
+      if (free_pad_str)
+        bounce_release(pad_str);
       return;
     }
     else
     {
-      if (dst_kind != src_kind || dest_char_array_is_longer || src_rank == 0)
-      {
-        if ((free_t_buff = ((t_buff = alloca(src_size * size)) == NULL)))
-        {
-          t_buff = malloc(src_size * size);
-          if (t_buff == NULL)
-            caf_runtime_error("Unable to allocate memory "
-                              "for internal buffer in get().");
-        }
-      }
-
       if ((same_type_and_kind && dst_rank == src_rank)
           || dst_type == BT_CHARACTER)
       {
@@ -4345,19 +7064,16 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
         {
           const size_t trans_size
               = ((dst_size > src_size) ? src_size : dst_size) * size;
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
-          ierr = MPI_Get(dest->base_addr, trans_size, MPI_BYTE, remote_image,
-                         offset, trans_size, MPI_BYTE, *p);
+          ierr = get_bytes(token, *p, remote_image, offset, dest->base_addr,
+                           trans_size);
           chk_err(ierr);
-          CAF_Win_unlock(remote_image, *p);
         }
         else
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
-          ierr = MPI_Get(t_buff, src_size, MPI_BYTE, remote_image, offset,
-                         src_size, MPI_BYTE, *p);
+          t_buff = bounce_alloc(src_size * size);
+          free_t_buff = true;
+          ierr = get_bytes(token, *p, remote_image, offset, t_buff, src_size);
           chk_err(ierr);
-          CAF_Win_unlock(remote_image, *p);
           copy_char_to_self(t_buff, src_type, src_size, src_kind,
                             dest->base_addr, dst_type, dst_size, dst_kind, size,
                             src_rank == 0);
@@ -4365,14 +7081,10 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
       }
       else
       {
-        CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
-        ierr = MPI_Get(t_buff, src_size * size, MPI_BYTE, remote_image, offset,
-                       src_size * size, MPI_BYTE, *p);
+        ierr = get_converted(token, *p, remote_image, offset, dest->base_addr,
+                             dst_type, dst_kind, dst_size, src_type, src_kind,
+                             src_size, src_rank == 0, size, stat);
         chk_err(ierr);
-        CAF_Win_unlock(remote_image, *p);
-        convert_with_strides(dest->base_addr, dst_type, dst_kind, dst_size,
-                             t_buff, src_type, src_kind,
-                             (src_rank > 0) ? src_size : 0, size, stat);
       }
     }
   }
@@ -4382,149 +7094,17 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
     /* For strided copy, no type and kind conversion, copy to self or
      * character arrays are supported. */
     MPI_Datatype dt_s, dt_d, base_type_src, base_type_dst;
-    int *arr_bl;
-    int *arr_dsp_s, *arr_dsp_d;
 
     selectType(src_size, &base_type_src);
     selectType(dst_size, &base_type_dst);
 
-    if (src_rank == 1)
-    {
-      if (src_vector == NULL)
-      {
-        dprint("Setting up mpi datatype vector with stride %d, "
-               "size %d and offset %d.\n",
-               src->dim[0]._stride, size, offset);
-        ierr = MPI_Type_vector(size, 1, src->dim[0]._stride, base_type_src,
-                               &dt_s);
-        chk_err(ierr);
-      }
-      else
-      {
-        arr_bl = calloc(size, sizeof(int));
-        arr_dsp_s = calloc(size, sizeof(int));
-
-        dprint("Setting up strided vector index.\n", caf_this_image,
-               caf_num_images, __FUNCTION__);
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    for (i = 0; i < size; ++i)                                                 \
-    {                                                                          \
-      arr_dsp_s[i] = ((ptrdiff_t)((type *)src_vector->u.v.vector)[i]           \
-                      - src->dim[0].lower_bound);                              \
-      arr_bl[i] = 1;                                                           \
-    }                                                                          \
-    break
-        switch (src_vector->u.v.kind)
-        {
-          KINDCASE(1, int8_t);
-          KINDCASE(2, int16_t);
-          KINDCASE(4, int32_t);
-          KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-          KINDCASE(16, __int128);
-#endif
-          default:
-            caf_runtime_error(unreachable);
-            return;
-        }
-#undef KINDCASE
-        ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_s, base_type_src, &dt_s);
-        chk_err(ierr);
-        free(arr_bl);
-        free(arr_dsp_s);
-      }
-      ierr = MPI_Type_vector(size, 1, dest->dim[0]._stride, base_type_dst,
-                             &dt_d);
-      chk_err(ierr);
-    }
-    else
-    {
-      arr_bl = calloc(size, sizeof(int));
-      arr_dsp_s = calloc(size, sizeof(int));
-      arr_dsp_d = calloc(size, sizeof(int));
-
-      for (i = 0; i < size; ++i)
-      {
-        arr_bl[i] = 1;
-      }
-
-      for (i = 0; i < size; ++i)
-      {
-        ptrdiff_t array_offset_sr = 0, extent = 1, tot_ext = 1;
-        if (src_vector == NULL)
-        {
-          for (j = 0; j < src_rank - 1; ++j)
-          {
-            extent = src->dim[j]._ubound - src->dim[j].lower_bound + 1;
-            array_offset_sr += ((i / tot_ext) % extent) * src->dim[j]._stride;
-            tot_ext *= extent;
-          }
-
-          array_offset_sr += (i / tot_ext) * src->dim[src_rank - 1]._stride;
-        }
-        else
-        {
-#define KINDCASE(kind, type)                                                   \
-  case kind:                                                                   \
-    array_offset_sr = ((ptrdiff_t)((type *)src_vector->u.v.vector)[i]          \
-                       - src->dim[0].lower_bound);                             \
-    break
-          switch (src_vector->u.v.kind)
-          {
-            KINDCASE(1, int8_t);
-            KINDCASE(2, int16_t);
-            KINDCASE(4, int32_t);
-            KINDCASE(8, int64_t);
-#ifdef HAVE_GFC_INTEGER_16
-            KINDCASE(16, __int128);
-#endif
-            default:
-              caf_runtime_error(unreachable);
-              return;
-          }
-#undef KINDCASE
-        }
-        arr_dsp_s[i] = array_offset_sr;
-
-        if (dst_rank != 0)
-        {
-          ptrdiff_t array_offset_dst = 0;
-          extent = 1;
-          tot_ext = 1;
-          for (j = 0; j < dst_rank - 1; ++j)
-          {
-            extent = dest->dim[j]._ubound - dest->dim[j].lower_bound + 1;
-            array_offset_dst += ((i / tot_ext) % extent) * dest->dim[j]._stride;
-            tot_ext *= extent;
-          }
-
-          array_offset_dst += (i / tot_ext) * dest->dim[src_rank - 1]._stride;
-          arr_dsp_d[i] = array_offset_dst;
-        }
-        else
-          arr_dsp_d[i] = 0;
-      }
-
-      ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_s, base_type_src, &dt_s);
-      chk_err(ierr);
-      ierr = MPI_Type_indexed(size, arr_bl, arr_dsp_d, base_type_dst, &dt_d);
-      chk_err(ierr);
-
-      free(arr_bl);
-      free(arr_dsp_s);
-      free(arr_dsp_d);
-    }
-
-    ierr = MPI_Type_commit(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_commit(&dt_d);
-    chk_err(ierr);
+    dt_s = create_section_type(src, src_rank, src_vector, size, base_type_src);
+    dt_d = create_section_type(dest, dst_rank, NULL, size, base_type_dst);
 
     CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
     ierr = MPI_Get(dest->base_addr, 1, dt_d, remote_image, offset, 1, dt_s, *p);
     chk_err(ierr);
-    CAF_Win_unlock(remote_image, *p);
+    CAF_Win_unlock_local(remote_image, *p);
 
 #ifdef WITH_FAILED_IMAGES
     check_image_health(image_index, stat);
@@ -4541,33 +7121,21 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
       return;
     }
 #endif
-    ierr = MPI_Type_free(&dt_s);
-    chk_err(ierr);
-    ierr = MPI_Type_free(&dt_d);
-    chk_err(ierr);
+    release_section_type(&dt_s);
+    release_section_type(&dt_d);
   }
 #endif // STRIDED
   else
   {
     if (same_image && mrt)
     {
-      if ((free_t_buff = (((t_buff = alloca(src_size * size))) == NULL)))
-      {
-        t_buff = malloc(src_size * size);
-        if (t_buff == NULL)
-          caf_runtime_error("Unable to allocate memory "
-                            "for internal buffer in get().");
-      }
+      t_buff = bounce_alloc(src_size * size);
+      free_t_buff = true;
     }
     else if (!same_type_and_kind && !same_image)
     {
-      if ((free_t_buff = (((t_buff = alloca(src_size))) == NULL)))
-      {
-        t_buff = malloc(src_size);
-        if (t_buff == NULL)
-          caf_runtime_error("Unable to allocate memory "
-                            "for internal buffer in get().");
-      }
+      t_buff = bounce_alloc(src_size);
+      free_t_buff = true;
     }
 
     for (i = 0; i < size; ++i)
@@ -4639,10 +7207,8 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
         if (same_type_and_kind)
         {
           const size_t trans_size = (src_size < dst_size) ? src_size : dst_size;
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
-          ierr = MPI_Get(dst, trans_size, MPI_BYTE, remote_image,
-                         offset + src_offset, trans_size, MPI_BYTE, *p);
-          CAF_Win_unlock(remote_image, *p);
+          ierr = get_bytes(token, *p, remote_image, offset + src_offset, dst,
+                           trans_size);
           chk_err(ierr);
           if (pad_str)
             memcpy((void *)((char *)dst + src_size), pad_str,
@@ -4650,20 +7216,16 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
         }
         else if (dst_type == BT_CHARACTER)
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
-          ierr = MPI_Get(t_buff, src_size, MPI_BYTE, remote_image,
-                         offset + src_offset, src_size, MPI_BYTE, *p);
-          CAF_Win_unlock(remote_image, *p);
+          ierr = get_bytes(token, *p, remote_image, offset + src_offset, t_buff,
+                           src_size);
           chk_err(ierr);
           copy_char_to_self(t_buff, src_type, src_size, src_kind, dst, dst_type,
                             dst_size, dst_kind, 1, true);
         }
         else
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, *p);
-          ierr = MPI_Get(t_buff, src_size, MPI_BYTE, remote_image,
-                         offset + src_offset, src_size, MPI_BYTE, *p);
-          CAF_Win_unlock(remote_image, *p);
+          ierr = get_bytes(token, *p, remote_image, offset + src_offset, t_buff,
+                           src_size);
           chk_err(ierr);
           convert_type(dst, dst_type, dst_kind, t_buff, src_type, src_kind,
                        stat);
@@ -4710,11 +7272,11 @@ PREFIX(get)(caf_token_t token, size_t offset, int image_index,
     }
   }
 
-  /* Free memory, when not allocated on stack. */
+  /* Return the staging buffers. */
   if (free_t_buff)
-    free(t_buff);
+    bounce_release(t_buff);
   if (free_pad_str)
-    free(pad_str);
+    bounce_release(pad_str);
 
 #ifdef WITH_FAILED_IMAGES
   /* Catch failed images, when failed image support is active. */
@@ -4750,6 +7312,9 @@ get_data(void *ds, mpi_caf_token_t *token, MPI_Aint offset, int dst_type,
   size_t k;
   int ierr;
   MPI_Win win = (token == NULL) ? global_dynamic_win : token->memptr_win;
+
+  if (token)
+    offset += token->memptr_disp;
 #ifdef EXTRA_DEBUG_OUTPUT
   if (token)
     dprint("%p = win(%d): %d -> offset: %zd of size %zd -> %zd, "
@@ -4765,9 +7330,7 @@ get_data(void *ds, mpi_caf_token_t *token, MPI_Aint offset, int dst_type,
   if (dst_type == src_type && dst_kind == src_kind)
   {
     size_t sz = ((dst_size > src_size) ? src_size : dst_size) * num;
-    CAF_Win_lock(MPI_LOCK_SHARED, image_index, win);
-    ierr = MPI_Get(ds, sz, MPI_BYTE, image_index, offset, sz, MPI_BYTE, win);
-    CAF_Win_unlock(image_index, win);
+    ierr = access_batch_add(false, token, win, image_index, offset, ds, sz);
     chk_err(ierr);
     if ((dst_type == BT_CHARACTER || src_type == BT_CHARACTER)
         && dst_size > src_size)
@@ -4785,45 +7348,29 @@ get_data(void *ds, mpi_caf_token_t *token, MPI_Aint offset, int dst_type,
   }
   else if (dst_type == BT_CHARACTER && dst_kind == 1)
   {
-    /* Get the required amount of memory on the stack. */
-    void *srh = alloca(src_size);
-    CAF_Win_lock(MPI_LOCK_SHARED, image_index, win);
-    ierr = MPI_Get(srh, src_size, MPI_BYTE, image_index, offset, src_size,
-                   MPI_BYTE, win);
+    void *srh = bounce_alloc(src_size);
+    ierr = get_bytes(token, win, image_index, offset, srh, src_size);
     chk_err(ierr);
-    CAF_Win_unlock(image_index, win);
     assign_char1_from_char4(dst_size, src_size, ds, srh);
+    bounce_release(srh);
   }
   else if (dst_type == BT_CHARACTER)
   {
-    /* Get the required amount of memory on the stack. */
-    void *srh = alloca(src_size);
-    CAF_Win_lock(MPI_LOCK_SHARED, image_index, win);
-    ierr = MPI_Get(srh, src_size, MPI_BYTE, image_index, offset, src_size,
-                   MPI_BYTE, win);
+    void *srh = bounce_alloc(src_size);
+    ierr = get_bytes(token, win, image_index, offset, srh, src_size);
     chk_err(ierr);
-    CAF_Win_unlock(image_index, win);
     assign_char4_from_char1(dst_size, src_size, ds, srh);
+    bounce_release(srh);
   }
   else
   {
-    /* Get the required amount of memory on the stack. */
-    void *srh = alloca(src_size * num);
     dprint("type/kind convert %zd items: "
-           "type %d(%d) -> type %d(%d), local buffer: %p\n",
-           num, src_type, src_kind, dst_type, dst_kind, srh);
-    CAF_Win_lock(MPI_LOCK_SHARED, image_index, win);
-    ierr = MPI_Get(srh, src_size * num, MPI_BYTE, image_index, offset,
-                   src_size * num, MPI_BYTE, win);
+           "type %d(%d) -> type %d(%d)\n",
+           num, src_type, src_kind, dst_type, dst_kind);
+    ierr = get_converted(token, win, image_index, offset, ds, dst_type,
+                         dst_kind, dst_size, src_type, src_kind, src_size,
+                         false, num, stat);
     chk_err(ierr);
-    CAF_Win_unlock(image_index, win);
-    dprint("srh[0] = %d, ierr = %d\n", (int)((char *)srh)[0], ierr);
-    for (k = 0; k < num; ++k)
-    {
-      convert_type(ds, dst_type, dst_kind, srh, src_type, src_kind, stat);
-      ds += dst_size;
-      srh += src_size;
-    }
   }
 }
 
@@ -4843,9 +7390,360 @@ get_data(void *ds, mpi_caf_token_t *token, MPI_Aint offset, int dst_type,
 
 typedef struct gfc_dim1_descriptor_t
 {
-  gfc_descriptor_t base;
-  descriptor_dimension dim[1];
-} gfc_dim1_descriptor_t;
+  gfc_descriptor_t base;
+  descriptor_dimension dim[1];
+} gfc_dim1_descriptor_t;
+
+/* Compiled access plans.
+ *
+ * The *_by_ref() routines get the chain of references built by the compiler
+ * on each call and have to interpret it completely.  In loops the chains
+ * passed for one token differ only in the indices.  Therefore the static
+ * shape of a chain, i.e., the types of the references, the component offsets
+ * and the modes of the array references, is compiled once into a plan, which
+ * is cached with the token.  The plan knows the rank of each array reference
+ * and, for each allocatable or pointer component, how many bytes of meta
+ * data to fetch from the remote image: when an array reference follows, the
+ * whole descriptor is fetched instead of just the data pointer, which is the
+ * descriptor's first member.
+ *
+ * The meta data fetched is remembered, so that the sizing pass and the
+ * transfer pass walking the same chain, and later calls referencing the same
+ * components, access each remote pointer and descriptor only once.  The
+ * meta data of an image is dropped, when the image's allocation epoch
+ * changes, i.e., when it registered or deregistered memory. */
+
+#define REF_PLAN_CACHE_SIZE 16
+#define REF_META_MEMO_SIZE 64
+
+struct ref_plan_step_t
+{
+  /* The static shape of the reference. */
+  int type;
+  size_t item_size;
+  ptrdiff_t offset, caf_token_offset;
+  int static_array_type;
+  unsigned char mode[GFC_MAX_DIMENSIONS];
+  /* For array references the number of dimensions referenced and whether
+   * all of them are single elements. */
+  int rank;
+  bool scalar;
+  /* For allocatable or pointer components the number of bytes of meta data
+   * to fetch at the component. */
+  size_t meta_size;
+  /* The reference this step is bound to in the current call. */
+  caf_reference_t *ref;
+};
+
+typedef struct caf_ref_plan_t
+{
+  struct caf_ref_plan_t *next;
+  uint64_t hash;
+  size_t num_steps;
+  struct ref_plan_step_t step[];
+} caf_ref_plan_t;
+
+/* A piece of remote meta data fetched from image (its rank in
+ * global_dynamic_win). */
+struct ref_meta_memo_t
+{
+  MPI_Win win;
+  int rank, image;
+  MPI_Aint disp;
+  size_t size;
+  gfc_max_dim_descriptor_t data;
+};
+
+/* The plans bound to the current *_by_ref() call and the tokens and images
+ * accessed with them.  sendget_by_ref() uses one for each side. */
+static caf_ref_plan_t *ref_plans_active[2];
+static mpi_caf_token_t *ref_plans_token[2];
+static int ref_plans_image[2];
+static struct ref_meta_memo_t ref_meta_memo[REF_META_MEMO_SIZE];
+static int ref_meta_memo_count = 0, ref_meta_memo_next = 0;
+
+/* Fill the static shape of step from ref and return the hash to continue
+ * with. */
+static uint64_t
+ref_plan_shape(struct ref_plan_step_t *step, const caf_reference_t *ref,
+               uint64_t hash)
+{
+  memset(step, 0, sizeof(struct ref_plan_step_t));
+  step->type = ref->type;
+  step->item_size = ref->item_size;
+  if (ref->type == CAF_REF_COMPONENT)
+  {
+    step->offset = ref->u.c.offset;
+    step->caf_token_offset = ref->u.c.caf_token_offset;
+  }
+  else
+  {
+    for (step->rank = 0; step->rank < GFC_MAX_DIMENSIONS
+                         && ref->u.a.mode[step->rank] != CAF_ARR_REF_NONE;
+         ++step->rank)
+      step->mode[step->rank] = ref->u.a.mode[step->rank];
+    if (ref->type == CAF_REF_STATIC_ARRAY)
+      step->static_array_type = ref->u.a.static_array_type;
+  }
+  /* FNV-1a over the shape, the padding is zeroed above. */
+  for (size_t b = 0; b < offsetof(struct ref_plan_step_t, scalar); ++b)
+    hash = (hash ^ ((unsigned char *)step)[b]) * 0x100000001b3ULL;
+  return hash;
+}
+
+/* Compile the static part of the plan's steps. */
+static void
+ref_plan_compile(caf_ref_plan_t *plan)
+{
+  for (size_t s = 0; s < plan->num_steps; ++s)
+  {
+    struct ref_plan_step_t *step = &plan->step[s];
+    step->scalar = true;
+    for (int d = 0; d < step->rank; ++d)
+      step->scalar = step->scalar && step->mode[d] == CAF_ARR_REF_SINGLE;
+    if (step->type == CAF_REF_COMPONENT && step->caf_token_offset > 0)
+      step->meta_size = (s + 1 < plan->num_steps
+                         && plan->step[s + 1].type == CAF_REF_ARRAY
+                         && plan->step[s + 1].rank > 0)
+                            ? sizeof_desc_for_rank(plan->step[s + 1].rank)
+                            : stdptr_size;
+  }
+}
+
+/* Look up the plan for refs in the token's cache, compile it when it is not
+ * present, and bind it to refs for accessing image.  slot selects which of
+ * the active plans of the current call to set. */
+static caf_ref_plan_t *
+ref_plan_bind(mpi_caf_token_t *token, caf_reference_t *refs, int slot,
+              int image)
+{
+  struct ref_plan_step_t shape[GFC_MAX_DIMENSIONS * 2], *steps = shape;
+  caf_ref_plan_t *plan, **pplan;
+  caf_reference_t *riter;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t num_steps = 0, s, cached = 0;
+
+  for (riter = refs; riter; riter = riter->next)
+    ++num_steps;
+  if (num_steps > sizeof(shape) / sizeof(shape[0]))
+  {
+    steps = malloc(num_steps * sizeof(struct ref_plan_step_t));
+    if (steps == NULL)
+      caf_runtime_error("can not allocate an access plan");
+  }
+  for (riter = refs, s = 0; riter; riter = riter->next, ++s)
+    hash = ref_plan_shape(&steps[s], riter, hash);
+
+  for (pplan = &token->ref_plans; (plan = *pplan); pplan = &plan->next)
+  {
+    if (plan->hash == hash && plan->num_steps == num_steps)
+    {
+      for (s = 0; s < num_steps; ++s)
+        if (memcmp(&plan->step[s], &steps[s],
+                   offsetof(struct ref_plan_step_t, scalar)))
+          break;
+      if (s == num_steps)
+        break;
+    }
+    /* Evict the least recently used plan when the cache is full. */
+    if (++cached == REF_PLAN_CACHE_SIZE - 1 && plan->next)
+    {
+      caf_ref_plan_t *tail = plan->next;
+      plan->next = NULL;
+      for (; tail; tail = plan)
+      {
+        plan = tail->next;
+        free(tail);
+      }
+      plan = NULL;
+      break;
+    }
+  }
+
+  if (plan)
+    /* Move to the front. */
+    *pplan = plan->next;
+  else
+  {
+    plan = malloc(sizeof(caf_ref_plan_t)
+                  + num_steps * sizeof(struct ref_plan_step_t));
+    if (plan == NULL)
+      caf_runtime_error("can not allocate an access plan");
+    plan->hash = hash;
+    plan->num_steps = num_steps;
+    memcpy(plan->step, steps, num_steps * sizeof(struct ref_plan_step_t));
+    ref_plan_compile(plan);
+    dprint("compiled access plan %p (hash %lx, %zd steps) for token %p.\n",
+           plan, (unsigned long)hash, num_steps, token);
+  }
+  plan->next = token->ref_plans;
+  token->ref_plans = plan;
+  if (steps != shape)
+    free(steps);
+
+  for (riter = refs, s = 0; riter; riter = riter->next, ++s)
+    plan->step[s].ref = riter;
+  ref_plans_active[slot] = plan;
+  ref_plans_token[slot] = token;
+  ref_plans_image[slot] = image;
+  return plan;
+}
+
+/* Start a new *_by_ref() call: forget the plans bound by the previous one. */
+static void
+ref_plan_begin(void)
+{
+  ref_plans_active[0] = ref_plans_active[1] = NULL;
+}
+
+/* Return the step of the active plans ref is bound to and set slot to the
+ * plan's slot, or return NULL. */
+static struct ref_plan_step_t *
+ref_plan_step(const caf_reference_t *ref, int *slot)
+{
+  for (int a = 0; a < 2; ++a)
+  {
+    caf_ref_plan_t *plan = ref_plans_active[a];
+    if (plan)
+      for (size_t s = 0; s < plan->num_steps; ++s)
+        if (plan->step[s].ref == ref)
+        {
+          *slot = a;
+          return &plan->step[s];
+        }
+  }
+  return NULL;
+}
+
+/* Note that this image registered or deregistered memory.  The meta data
+ * cached is dropped, because it may refer to this image's memory. */
+static void
+alloc_epoch_bump(void)
+{
+  int ierr;
+
+  CAF_Win_lock(MPI_LOCK_EXCLUSIVE, global_this_image, alloc_epoch_win);
+  ++caf_alloc_epoch;
+  ierr = CAF_Win_unlock(global_this_image, alloc_epoch_win);
+  chk_err(ierr);
+  ref_meta_memo_count = ref_meta_memo_next = 0;
+}
+
+/* Drop the meta data cached for image, when the image has moved on to a new
+ * allocation epoch.  Checked once per segment only. */
+static void
+alloc_epoch_check(int image)
+{
+  struct alloc_epoch_seen_t *seen = &alloc_epoch_seen[image];
+  uint64_t epoch;
+  int ierr, m, n;
+
+  if (seen->segment == caf_segment)
+    return;
+  CAF_Win_lock(MPI_LOCK_SHARED, image, alloc_epoch_win);
+  ierr = MPI_Get(&epoch, sizeof(uint64_t), MPI_BYTE, image, 0,
+                 sizeof(uint64_t), MPI_BYTE, alloc_epoch_win);
+  chk_err(ierr);
+  CAF_Win_unlock_local(image, alloc_epoch_win);
+  seen->segment = caf_segment;
+  if (epoch == seen->epoch)
+    return;
+  dprint("allocation epoch of image %d moved from %lu to %lu.\n", image + 1,
+         (unsigned long)seen->epoch, (unsigned long)epoch);
+  seen->epoch = epoch;
+  for (m = n = 0; m < ref_meta_memo_count; ++m)
+    if (ref_meta_memo[m].image != image)
+    {
+      if (m != n)
+        ref_meta_memo[n] = ref_meta_memo[m];
+      ++n;
+    }
+  ref_meta_memo_count = n;
+  ref_meta_memo_next = n % REF_META_MEMO_SIZE;
+}
+
+static void
+ref_plans_free(mpi_caf_token_t *token)
+{
+  caf_ref_plan_t *plan;
+
+  while ((plan = token->ref_plans))
+  {
+    token->ref_plans = plan->next;
+    if (ref_plans_active[0] == plan)
+      ref_plans_active[0] = NULL;
+    if (ref_plans_active[1] == plan)
+      ref_plans_active[1] = NULL;
+    free(plan);
+  }
+}
+
+/* Fetch size bytes of meta data (a pointer or a descriptor) for the
+ * reference ref from disp in win on image rank into dst.  Meta data of this
+ * image or in node-local memory is read directly.  Meta data already fetched
+ * in the current allocation epoch of the image is taken from the memo.  When
+ * the plan asks for more bytes at ref, those are fetched along. */
+static int
+get_ref_meta(void *dst, size_t size, const caf_reference_t *ref, MPI_Win win,
+             int rank, MPI_Aint disp)
+{
+  struct ref_meta_memo_t *memo;
+  size_t fetch = size;
+  int ierr, image = -1, slot;
+  struct ref_plan_step_t *step = ref_plan_step(ref, &slot);
+  void *addr = local_address(step ? ref_plans_token[slot] : NULL, win, rank,
+                             disp);
+
+  if (addr)
+  {
+    memcpy(dst, addr, size);
+    return MPI_SUCCESS;
+  }
+  if (step)
+  {
+    image = ref_plans_image[slot];
+    alloc_epoch_check(image);
+  }
+  for (int m = 0; step && m < ref_meta_memo_count; ++m)
+  {
+    memo = &ref_meta_memo[m];
+    if (memo->win == win && memo->rank == rank && disp >= memo->disp
+        && (size_t)(disp - memo->disp) + size <= memo->size)
+    {
+      memcpy(dst, (char *)&memo->data + (disp - memo->disp), size);
+      return MPI_SUCCESS;
+    }
+  }
+
+  if (step && step->meta_size > fetch)
+    fetch = step->meta_size;
+  if (step == NULL || fetch > sizeof(gfc_max_dim_descriptor_t))
+  {
+    /* Not bound to a plan or too large for the memo, fetch directly. */
+    CAF_Win_lock(MPI_LOCK_SHARED, rank, win);
+    ierr = MPI_Get(dst, size, MPI_BYTE, rank, disp, size, MPI_BYTE, win);
+    CAF_Win_unlock_local(rank, win);
+    return ierr;
+  }
+
+  memo = &ref_meta_memo[ref_meta_memo_next];
+  ref_meta_memo_next = (ref_meta_memo_next + 1) % REF_META_MEMO_SIZE;
+  if (ref_meta_memo_count < REF_META_MEMO_SIZE)
+    ++ref_meta_memo_count;
+  memo->win = win;
+  memo->rank = rank;
+  memo->image = image;
+  memo->disp = disp;
+  memo->size = 0;
+  CAF_Win_lock(MPI_LOCK_SHARED, rank, win);
+  ierr = MPI_Get(&memo->data, fetch, MPI_BYTE, rank, disp, fetch, MPI_BYTE,
+                 win);
+  CAF_Win_unlock_local(rank, win);
+  if (ierr == MPI_SUCCESS)
+    memo->size = fetch;
+  memcpy(dst, &memo->data, size);
+  return ierr;
+}
 
 static void
 get_for_ref(caf_reference_t *ref, size_t *i, size_t dst_index,
@@ -4896,24 +7794,18 @@ get_for_ref(caf_reference_t *ref, size_t *i, size_t dst_index,
           sr_byte_offset += ref->u.c.offset;
           if (sr_global)
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(&sr, stdptr_size, MPI_BYTE, global_dynamic_win_rank,
-                           MPI_Aint_add((MPI_Aint)sr, sr_byte_offset),
-                           stdptr_size, MPI_BYTE, global_dynamic_win);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
+            ierr = get_ref_meta(&sr, stdptr_size, ref, global_dynamic_win,
+                                global_dynamic_win_rank,
+                                MPI_Aint_add((MPI_Aint)sr, sr_byte_offset));
             chk_err(ierr);
             desc_global = true;
           }
           else
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(&sr, stdptr_size, MPI_BYTE, memptr_win_rank,
-                           sr_byte_offset, stdptr_size, MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(&sr, stdptr_size, ref, mpi_token->memptr_win,
+                                memptr_win_rank,
+                                sr_byte_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             sr_global = true;
           }
           sr_byte_offset = 0;
@@ -4995,23 +7887,18 @@ get_for_ref(caf_reference_t *ref, size_t *i, size_t dst_index,
         rdesc = sr;
         if (sr_global)
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                       global_dynamic_win);
-          ierr = MPI_Get(&sr, stdptr_size, MPI_BYTE, global_dynamic_win_rank,
-                         MPI_Aint_add((MPI_Aint)sr, sr_byte_offset),
-                         stdptr_size, MPI_BYTE, global_dynamic_win);
-          CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
+          ierr = get_ref_meta(&sr, stdptr_size, ref, global_dynamic_win,
+                              global_dynamic_win_rank,
+                              MPI_Aint_add((MPI_Aint)sr, sr_byte_offset));
           chk_err(ierr);
           desc_global = true;
         }
         else
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank, mpi_token->memptr_win);
-          ierr = MPI_Get(&sr, stdptr_size, MPI_BYTE, memptr_win_rank,
-                         sr_byte_offset, stdptr_size, MPI_BYTE,
-                         mpi_token->memptr_win);
+          ierr = get_ref_meta(&sr, stdptr_size, ref, mpi_token->memptr_win,
+                              memptr_win_rank,
+                              sr_byte_offset + mpi_token->memptr_disp);
           chk_err(ierr);
-          CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
           sr_global = true;
         }
         sr_byte_offset = 0;
@@ -5058,27 +7945,19 @@ get_for_ref(caf_reference_t *ref, size_t *i, size_t dst_index,
           {
             MPI_Aint disp = MPI_Aint_add((MPI_Aint)rdesc, desc_byte_offset);
             dprint("Fetching remote descriptor from %lx.\n", disp);
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(&src_desc_data, sizeof_desc_for_rank(ref_rank),
-                           MPI_BYTE, global_dynamic_win_rank, disp,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           global_dynamic_win);
+            ierr = get_ref_meta(
+                &src_desc_data, sizeof_desc_for_rank(ref_rank), ref,
+                global_dynamic_win, global_dynamic_win_rank, disp);
             chk_err(ierr);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
             sr = src_desc_data.base.base_addr;
           }
           else
           {
             dprint("Fetching remote data.\n");
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(&src_desc_data, sizeof_desc_for_rank(ref_rank),
-                           MPI_BYTE, memptr_win_rank, desc_byte_offset,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(&src_desc_data, sizeof_desc_for_rank(ref_rank),
+                                ref, mpi_token->memptr_win, memptr_win_rank,
+                                desc_byte_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             desc_global = true;
           }
           src = (gfc_descriptor_t *)&src_desc_data;
@@ -5473,7 +8352,8 @@ get_from_self(caf_token_t token, const gfc_descriptor_t *opt_src_desc,
                       ? (dst_incl_desc ? opt_dst_desc : (void *)&tmp_desc)
                       : dst_data;
   const bool needs_copy_back = opt_dst_desc && !may_realloc_dst;
-  mpi_caf_token_t src_token = {get_data, MPI_WIN_NULL, NULL};
+  mpi_caf_token_t src_token
+      = {.memptr = get_data, .memptr_win = MPI_WIN_NULL, .desc = NULL};
   void *src_ptr = has_src_desc ? (void *)opt_src_desc
                                : ((mpi_caf_token_t *)token)->memptr;
 
@@ -5528,11 +8408,8 @@ PREFIX(get_from_remote)(caf_token_t token, const gfc_descriptor_t *opt_src_desc,
                         caf_team_t *team __attribute__((unused)),
                         int *team_number __attribute__((unused)))
 {
-  MPI_Group current_team_group, win_group;
   int ierr, this_image, remote_image;
-  int trans_ranks[2];
-  bool free_t_buff, free_msg;
-  void *t_buff;
+  bool free_msg;
   ct_msg_t *msg;
   const bool dst_incl_desc = opt_dst_desc && may_realloc_dst,
              has_src_desc = opt_src_desc,
@@ -5545,7 +8422,6 @@ PREFIX(get_from_remote)(caf_token_t token, const gfc_descriptor_t *opt_src_desc,
                      : 0,
       msg_size
       = sizeof(ct_msg_t) + dst_desc_size + src_desc_size + get_data_size;
-  struct running_accesses_t *rat;
 
   if (stat)
     *stat = 0;
@@ -5553,20 +8429,8 @@ PREFIX(get_from_remote)(caf_token_t token, const gfc_descriptor_t *opt_src_desc,
   // Get mapped remote image
   if (external_call)
   {
-    ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Win_get_group(*TOKEN(token), &win_group);
-    chk_err(ierr);
-    ierr = MPI_Group_translate_ranks(current_team_group, 2,
-                                     (int[]){image_index - 1, mpi_this_image},
-                                     win_group, trans_ranks);
-    chk_err(ierr);
-    remote_image = trans_ranks[0];
-    this_image = trans_ranks[1];
-    ierr = MPI_Group_free(&current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&win_group);
-    chk_err(ierr);
+    remote_image = win_rank(TOKEN_WIN_RANKS(token), image_index - 1);
+    this_image = win_rank(TOKEN_WIN_RANKS(token), mpi_this_image);
   }
   else
   {
@@ -5590,24 +8454,20 @@ PREFIX(get_from_remote)(caf_token_t token, const gfc_descriptor_t *opt_src_desc,
     return;
   }
   // create get msg
-  if ((free_msg = (((msg = alloca(msg_size))) == NULL)))
-  {
-    msg = malloc(msg_size);
-    if (msg == NULL)
-      caf_runtime_error("Unable to allocate memory "
-                        "for internal message in get_from_remote().");
-  }
+  msg = bounce_alloc(msg_size);
+  free_msg = true;
   msg->cmd = remote_command_get;
   msg->transfer_size = dst_size;
   msg->opt_charlen = opt_src_charlen ? *opt_src_charlen : 0;
   msg->win = *TOKEN(token);
+  msg->win_disp = TOKEN_DISP(token);
   msg->dest_image = mpi_this_image;
   msg->dest_tag = CAF_CT_TAG + 1;
   msg->dest_opt_charlen = opt_dst_charlen ? *opt_dst_charlen : 1;
   msg->flags = (opt_dst_desc ? CT_DST_HAS_DESC : 0)
                | (has_src_desc ? CT_SRC_HAS_DESC : 0)
                | (opt_src_charlen ? CT_CHAR_ARRAY : 0)
-               | (dst_incl_desc ? CT_INCLUDE_DESCRIPTOR : 0);
+               | (dst_incl_desc ? CT_INCLUDE_DESCRIPTOR : 0) | CT_RESULT_HEADER;
   dprint("message flags: %x.\n", msg->flags);
   msg->accessor_index = getter_index;
   if (opt_dst_desc)
@@ -5619,104 +8479,71 @@ PREFIX(get_from_remote)(caf_token_t token, const gfc_descriptor_t *opt_src_desc,
 
   if (external_call)
   {
-    msg->ra_id = running_accesses_id_cnt++;
-    rat = (struct running_accesses_t *)malloc(
-        sizeof(struct running_accesses_t));
-    rat->id = msg->ra_id;
-    rat->memptr = msg->data + dst_desc_size + src_desc_size;
-    rat->next = running_accesses;
-    running_accesses = rat;
+    msg->ra_id
+        = running_access_register(msg->data + dst_desc_size + src_desc_size);
   }
   else
     msg->ra_id = (rat_id_t)((struct mpi_caf_token_t *)token)->memptr;
 
   // call get on remote
-  ierr = MPI_Send(msg, msg_size, MPI_BYTE, remote_image, CAF_CT_TAG, ct_COMM);
+  ierr = ct_send(msg, msg_size, remote_image);
   chk_err(ierr);
 
-  if (!opt_dst_charlen && !dst_incl_desc)
-  {
-    // allocate local buffer
-    if ((free_t_buff = (((t_buff = alloca(dst_size))) == NULL)))
-    {
-      t_buff = malloc(dst_size);
-      if (t_buff == NULL)
-        caf_runtime_error("Unable to allocate memory "
-                          "for internal buffer in get_from_remote().");
-    }
-    dprint("waiting to receive %zd bytes from %d.\n", dst_size,
-           image_index - 1);
-    ierr = MPI_Recv(t_buff, dst_size, MPI_BYTE, image_index - 1, msg->dest_tag,
-                    CAF_COMM_WORLD, MPI_STATUS_IGNORE);
-    chk_err(ierr);
-    dprint("received %zd bytes as requested from %d.\n", dst_size,
-           image_index - 1);
-    // dump_mem("get_from_remote", t_buff, dst_size);
-    memcpy(*dst_data, t_buff, dst_size);
-
-    if (free_t_buff)
-      free(t_buff);
-  }
-  else
+  /* The result is received directly into its destination, see struct
+   * ct_result_t. */
   {
-    MPI_Status status;
-    MPI_Message msg_han;
-    int cnt;
+    struct ct_result_t res;
+    MPI_Aint dest[2];
+    char c = 0;
 
-    dprint("probing for incoming message from %d, tag %d.\n", image_index - 1,
-           msg->dest_tag);
-    ierr = MPI_Mprobe(image_index - 1, msg->dest_tag, CAF_COMM_WORLD, &msg_han,
-                      &status);
+    dprint("waiting to receive the result header from %d.\n",
+           image_index - 1);
+    ierr = MPI_Recv(&res, sizeof(res), MPI_BYTE, image_index - 1,
+                    msg->dest_tag, CAF_COMM_WORLD, MPI_STATUS_IGNORE);
     chk_err(ierr);
-    if (ierr == MPI_SUCCESS)
-    {
-      MPI_Get_count(&status, MPI_BYTE, &cnt);
-      dprint("get message of %d bytes from image %d, tag %d, dest_addr %p.\n",
-             cnt, image_index - 1, msg->dest_tag, *dst_data);
-      if (may_realloc_dst)
-        *dst_data = realloc(*dst_data, cnt);
-      // else // max cnt
-      ierr = MPI_Mrecv(*dst_data, cnt, MPI_BYTE, &msg_han, &status);
+    dprint("result of %zd bytes with descriptor of %zd bytes, landing: %d.\n",
+           res.data_size, res.desc_size, res.landing);
+    if (res.desc_size)
+      memcpy(opt_dst_desc, &res.desc, res.desc_size);
+    if ((opt_dst_charlen || dst_incl_desc) && may_realloc_dst)
+      *dst_data = realloc(*dst_data, res.data_size);
+    if (res.landing)
+    {
+      ierr = MPI_Win_attach(ct_landing_win, *dst_data, res.data_size);
       chk_err(ierr);
-      if (opt_dst_charlen)
-        *opt_dst_charlen = cnt / dst_size;
-      if (dst_incl_desc)
-      {
-        const size_t desc_size = sizeof_desc_for_rank(
-            GFC_DESCRIPTOR_RANK((gfc_descriptor_t *)(*dst_data)));
-        dprint("refitting dst descriptor of size %zd at %p with data %zd at %p "
-               "from %d bytes transfered.\n",
-               desc_size, opt_dst_desc, cnt - desc_size, *dst_data, cnt);
-        memcpy(opt_dst_desc, *dst_data, desc_size);
-        memmove(*dst_data, (*dst_data) + desc_size, cnt - desc_size);
-        opt_dst_desc->base_addr = *dst_data
-            = realloc(*dst_data, cnt - desc_size);
-        dump_mem("ret data", opt_dst_desc->base_addr, cnt - desc_size);
-      }
+      ierr = MPI_Get_address(*dst_data, &dest[0]);
+      chk_err(ierr);
+      dest[1] = global_this_image;
+      ierr = MPI_Send(dest, 2, MPI_AINT, remote_image, CAF_CT_LANDING_TAG,
+                      ct_COMM);
+      chk_err(ierr);
+      ierr = MPI_Recv(&c, 1, MPI_BYTE, image_index - 1, msg->dest_tag,
+                      CAF_COMM_WORLD, MPI_STATUS_IGNORE);
+      chk_err(ierr);
+      ierr = MPI_Win_detach(ct_landing_win, *dst_data);
+      chk_err(ierr);
+      if (c)
+        caf_runtime_error("Getting %zd bytes from image %d failed",
+                          res.data_size, image_index);
     }
     else
     {
-      int err_len;
-      char err_str[MPI_MAX_ERROR_STRING];
-      MPI_Error_string(status.MPI_ERROR, err_str, &err_len);
-      caf_runtime_error("Got MPI error %d retrieving result: %s",
-                        status.MPI_ERROR, err_str);
+      ierr = MPI_Recv(*dst_data, res.data_size, MPI_BYTE, image_index - 1,
+                      msg->dest_tag, CAF_COMM_WORLD, MPI_STATUS_IGNORE);
+      chk_err(ierr);
     }
+    if (opt_dst_charlen)
+      *opt_dst_charlen = res.data_size / dst_size;
+    if (dst_incl_desc)
+      opt_dst_desc->base_addr = *dst_data;
+    dump_mem("ret data", *dst_data, res.data_size);
   }
 
-  if (running_accesses == rat)
-    running_accesses = rat->next;
-  else
-  {
-    struct running_accesses_t *pra = running_accesses;
-    for (; pra && pra->next != rat; pra = pra->next)
-      ;
-    pra->next = rat->next;
-  }
-  free(rat);
+  if (external_call)
+    running_access_release(msg->ra_id);
 
   if (free_msg)
-    free(msg);
+    bounce_release(msg);
 
   dprint("done with get_from_remote.\n");
 }
@@ -5730,30 +8557,15 @@ PREFIX(is_present_on_remote)(caf_token_t token, const int image_index,
   if (!token)
     return 0;
 
-  MPI_Group current_team_group, win_group;
   int ierr, this_image, remote_image;
-  int trans_ranks[2];
   bool free_msg;
   int32_t result = 0;
   ct_msg_t *msg;
   const size_t msg_size = sizeof(ct_msg_t) + add_data_size;
-  struct running_accesses_t *rat;
 
   // Get mapped remote image
-  ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(*TOKEN(token), &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 2,
-                                   (int[]){image_index - 1, mpi_this_image},
-                                   win_group, trans_ranks);
-  chk_err(ierr);
-  remote_image = trans_ranks[0];
-  this_image = trans_ranks[1];
-  ierr = MPI_Group_free(&current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
+  remote_image = win_rank(TOKEN_WIN_RANKS(token), image_index - 1);
+  this_image = win_rank(TOKEN_WIN_RANKS(token), mpi_this_image);
 
   check_image_health(remote_image, stat);
 
@@ -5765,7 +8577,8 @@ PREFIX(is_present_on_remote)(caf_token_t token, const int image_index,
   if (this_image == remote_image)
   {
     int32_t result = 0;
-    mpi_caf_token_t src_token = {get_data, MPI_WIN_NULL, NULL};
+    mpi_caf_token_t src_token
+      = {.memptr = get_data, .memptr_win = MPI_WIN_NULL, .desc = NULL};
     void *src_ptr = ((mpi_caf_token_t *)token)->memptr;
 
     dprint("Shortcutting due to self access on image %d.\n", image_index);
@@ -5776,17 +8589,13 @@ PREFIX(is_present_on_remote)(caf_token_t token, const int image_index,
   }
 
   // create get msg
-  if ((free_msg = (((msg = alloca(msg_size))) == NULL)))
-  {
-    msg = malloc(msg_size);
-    if (msg == NULL)
-      caf_runtime_error("Unable to allocate memory "
-                        "for internal message in get_from_remote().");
-  }
+  msg = bounce_alloc(msg_size);
+  free_msg = true;
   msg->cmd = remote_command_present;
   msg->transfer_size = 1;
   msg->opt_charlen = 0;
   msg->win = *TOKEN(token);
+  msg->win_disp = TOKEN_DISP(token);
   msg->dest_image = mpi_this_image;
   msg->dest_tag = CAF_CT_TAG + 1;
   msg->dest_opt_charlen = 0;
@@ -5796,15 +8605,10 @@ PREFIX(is_present_on_remote)(caf_token_t token, const int image_index,
 
   memcpy(msg->data, add_data, add_data_size);
 
-  msg->ra_id = running_accesses_id_cnt++;
-  rat = (struct running_accesses_t *)malloc(sizeof(struct running_accesses_t));
-  rat->id = msg->ra_id;
-  rat->memptr = msg->data;
-  rat->next = running_accesses;
-  running_accesses = rat;
+  msg->ra_id = running_access_register(msg->data);
 
   // call get on remote
-  ierr = MPI_Send(msg, msg_size, MPI_BYTE, remote_image, CAF_CT_TAG, ct_COMM);
+  ierr = ct_send(msg, msg_size, remote_image);
   chk_err(ierr);
 
   dprint("waiting to receive %d bytes from %d.\n", 1, image_index - 1);
@@ -5813,18 +8617,9 @@ PREFIX(is_present_on_remote)(caf_token_t token, const int image_index,
   chk_err(ierr);
   dprint("received %d bytes as requested from %d.\n", 1, image_index - 1);
 
-  if (running_accesses == rat)
-    running_accesses = rat->next;
-  else
-  {
-    struct running_accesses_t *pra = running_accesses;
-    for (; pra && pra->next != rat; pra = pra->next)
-      ;
-    pra->next = rat->next;
-  }
-  free(rat);
+  running_access_release(msg->ra_id);
   if (free_msg)
-    free(msg);
+    bounce_release(msg);
 
   dprint("done with is_present_on_remote.\n");
   return result;
@@ -5844,7 +8639,8 @@ send_to_self(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
         || (!opt_src_desc && ((mpi_caf_token_t *)token)->memptr == src_data);
   void *dst_ptr
       = opt_dst_desc ? opt_dst_desc : ((mpi_caf_token_t *)token)->memptr;
-  mpi_caf_token_t src_token = {add_data, MPI_WIN_NULL, NULL};
+  mpi_caf_token_t src_token
+      = {.memptr = add_data, .memptr_win = MPI_WIN_NULL, .desc = NULL};
   const void *src_ptr = opt_src_desc ? opt_src_desc : src_data,
              *orig_src_ptr = src_ptr;
   const size_t sz
@@ -5855,13 +8651,8 @@ send_to_self(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
   if (requires_temp)
   {
     void *tmp_ptr;
-    if ((free_tmp = (tmp_ptr = alloca(sz)) == NULL))
-    {
-      tmp_ptr = malloc(sz);
-      if (!tmp_ptr)
-        caf_runtime_error("can not allocate %zd bytes for temp buffer in send",
-                          sz);
-    }
+    tmp_ptr = bounce_alloc(sz);
+    free_tmp = true;
     memcpy(tmp_ptr, opt_src_desc ? opt_src_desc->base_addr : src_ptr, sz);
     if (opt_src_desc)
     {
@@ -5884,11 +8675,11 @@ send_to_self(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
     if (opt_src_desc)
     {
       if (free_tmp)
-        free(opt_src_desc->base_addr);
+        bounce_release(opt_src_desc->base_addr);
       ((gfc_descriptor_t *)opt_src_desc)->base_addr = (void *)orig_src_ptr;
     }
     else if (free_tmp)
-      free((void *)src_ptr);
+      bounce_release((void *)src_ptr);
   }
 }
 
@@ -5919,9 +8710,7 @@ PREFIX(send_to_remote)(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
                        caf_team_t *team __attribute__((unused)),
                        int *team_number __attribute__((unused)))
 {
-  MPI_Group current_team_group, win_group;
   int ierr, this_image, remote_image;
-  int trans_ranks[2];
   bool free_msg;
   ct_msg_t *msg;
   const bool dst_incl_desc = opt_dst_desc, has_src_desc = opt_src_desc,
@@ -5936,7 +8725,6 @@ PREFIX(send_to_remote)(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
       = opt_src_charlen ? in_src_size * *opt_src_charlen : in_src_size,
       msg_size = sizeof(ct_msg_t) + src_size + dst_desc_size + src_desc_size
                  + add_data_size;
-  struct running_accesses_t *rat;
 
   if (stat)
     *stat = 0;
@@ -5944,20 +8732,8 @@ PREFIX(send_to_remote)(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
   // Get mapped remote image
   if (external_call)
   {
-    ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Win_get_group(*TOKEN(token), &win_group);
-    chk_err(ierr);
-    ierr = MPI_Group_translate_ranks(current_team_group, 2,
-                                     (int[]){image_index - 1, mpi_this_image},
-                                     win_group, trans_ranks);
-    chk_err(ierr);
-    remote_image = trans_ranks[0];
-    this_image = trans_ranks[1];
-    ierr = MPI_Group_free(&current_team_group);
-    chk_err(ierr);
-    ierr = MPI_Group_free(&win_group);
-    chk_err(ierr);
+    remote_image = win_rank(TOKEN_WIN_RANKS(token), image_index - 1);
+    this_image = win_rank(TOKEN_WIN_RANKS(token), mpi_this_image);
   }
   else
   {
@@ -5991,17 +8767,13 @@ PREFIX(send_to_remote)(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
   }
 
   // create get msg
-  if ((free_msg = (((msg = alloca(msg_size))) == NULL)))
-  {
-    msg = malloc(msg_size);
-    if (msg == NULL)
-      caf_runtime_error("Unable to allocate memory "
-                        "for internal message in send_to_remote().");
-  }
+  msg = bounce_alloc(msg_size);
+  free_msg = true;
   msg->cmd = remote_command_send;
   msg->transfer_size = src_size;
   msg->opt_charlen = opt_src_charlen ? *opt_src_charlen : 0;
   msg->win = *TOKEN(token);
+  msg->win_disp = TOKEN_DISP(token);
   msg->dest_image = mpi_this_image;
   msg->dest_tag = CAF_CT_TAG + 1;
   msg->dest_opt_charlen = opt_dst_charlen ? *opt_dst_charlen : 1;
@@ -6026,19 +8798,14 @@ PREFIX(send_to_remote)(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
 
   if (external_call)
   {
-    msg->ra_id = running_accesses_id_cnt++;
-    rat = (struct running_accesses_t *)malloc(
-        sizeof(struct running_accesses_t));
-    rat->id = msg->ra_id;
-    rat->memptr = msg->data + src_size + dst_desc_size + src_desc_size;
-    rat->next = running_accesses;
-    running_accesses = rat;
+    msg->ra_id = running_access_register(msg->data + src_size + dst_desc_size
+                                         + src_desc_size);
   }
   else
     msg->ra_id = (rat_id_t)((struct mpi_caf_token_t *)token)->memptr;
 
   // call get on remote
-  ierr = MPI_Send(msg, msg_size, MPI_BYTE, remote_image, CAF_CT_TAG, ct_COMM);
+  ierr = ct_send(msg, msg_size, remote_image);
   chk_err(ierr);
 
   {
@@ -6052,19 +8819,11 @@ PREFIX(send_to_remote)(caf_token_t token, gfc_descriptor_t *opt_dst_desc,
            image_index, msg->dest_tag);
   }
 
-  if (running_accesses == rat)
-    running_accesses = rat->next;
-  else
-  {
-    struct running_accesses_t *pra = running_accesses;
-    for (; pra && pra->next != rat; pra = pra->next)
-      ;
-    pra->next = rat->next;
-  }
-  free(rat);
+  if (external_call)
+    running_access_release(msg->ra_id);
 
   if (free_msg)
-    free(msg);
+    bounce_release(msg);
 
   dprint("done with send_to_remote.\n");
 }
@@ -6111,9 +8870,7 @@ PREFIX(transfer_between_remotes)(
     caf_team_t *src_team __attribute__((unused)),
     int *src_team_number __attribute__((unused)))
 {
-  MPI_Group current_team_group, win_group;
   int ierr, this_image, src_remote_image, dst_remote_image;
-  int trans_ranks[3];
   bool free_msg;
   ct_msg_t *full_msg, *dst_msg;
   struct transfer_msg_data_t *tmd;
@@ -6130,7 +8887,6 @@ PREFIX(transfer_between_remotes)(
                      + dst_desc_size + dst_add_data_size,
       full_msg_size
       = sizeof(ct_msg_t) + dst_msg_size + src_desc_size + src_add_data_size;
-  struct running_accesses_t *rat;
 
   if (dst_stat)
     *dst_stat = 0;
@@ -6138,22 +8894,9 @@ PREFIX(transfer_between_remotes)(
     *src_stat = 0;
 
   // Get mapped remote image
-  ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(*TOKEN(src_token), &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(
-      current_team_group, 3,
-      (int[]){src_image_index - 1, dst_image_index - 1, mpi_this_image},
-      win_group, trans_ranks);
-  chk_err(ierr);
-  src_remote_image = trans_ranks[0];
-  dst_remote_image = trans_ranks[1];
-  this_image = trans_ranks[2];
-  ierr = MPI_Group_free(&current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
+  src_remote_image = win_rank(TOKEN_WIN_RANKS(src_token), src_image_index - 1);
+  dst_remote_image = win_rank(TOKEN_WIN_RANKS(src_token), dst_image_index - 1);
+  this_image = win_rank(TOKEN_WIN_RANKS(src_token), mpi_this_image);
 
   dprint("team-map: dst(in) %d -> %d, src(in) %d -> %d, this %d -> %d.\n",
          dst_image_index, dst_remote_image, src_image_index, src_remote_image,
@@ -6254,17 +8997,13 @@ PREFIX(transfer_between_remotes)(
   }
 
   // create get msg
-  if ((free_msg = (((full_msg = alloca(full_msg_size))) == NULL)))
-  {
-    full_msg = malloc(full_msg_size);
-    if (full_msg == NULL)
-      caf_runtime_error("Unable to allocate memory "
-                        "for internal message in transfer_between_remotes().");
-  }
+  full_msg = bounce_alloc(full_msg_size);
+  free_msg = true;
   full_msg->cmd = remote_command_transfer;
   full_msg->transfer_size = src_size;
   full_msg->opt_charlen = opt_src_charlen ? *opt_src_charlen : 0;
   full_msg->win = *TOKEN(src_token);
+  full_msg->win_disp = TOKEN_DISP(src_token);
   full_msg->dest_image = dst_remote_image;
   full_msg->dest_tag = CAF_CT_TAG;
   full_msg->dest_opt_charlen = opt_dst_charlen ? *opt_dst_charlen : 1;
@@ -6281,6 +9020,7 @@ PREFIX(transfer_between_remotes)(
   dst_msg->transfer_size = src_size;
   dst_msg->opt_charlen = opt_src_charlen ? *opt_src_charlen : 0;
   dst_msg->win = *TOKEN(dst_token);
+  dst_msg->win_disp = TOKEN_DISP(dst_token);
   dst_msg->dest_image = mpi_this_image;
   dst_msg->dest_tag = CAF_CT_TAG + 1;
   dst_msg->dest_opt_charlen = opt_dst_charlen ? *opt_dst_charlen : 1;
@@ -6308,18 +9048,13 @@ PREFIX(transfer_between_remotes)(
   memcpy(tmd->data + dst_desc_size + dst_add_data_size + src_desc_size,
          src_add_data, src_add_data_size);
 
-  full_msg->ra_id = running_accesses_id_cnt++;
-  rat = (struct running_accesses_t *)malloc(sizeof(struct running_accesses_t));
-  rat->id = full_msg->ra_id;
-  rat->memptr = full_msg->data + src_size + dst_desc_size + src_desc_size;
-  rat->next = running_accesses;
-  running_accesses = rat;
+  full_msg->ra_id = running_access_register(full_msg->data + src_size
+                                            + dst_desc_size + src_desc_size);
 
   // initiate transfer on getter
   dprint("message size is %zd, dst_desc_size: %zd, src_desc_size: %zd.\n",
          full_msg_size, dst_desc_size, src_desc_size);
-  ierr = MPI_Send(full_msg, full_msg_size, MPI_BYTE, src_remote_image,
-                  CAF_CT_TAG, ct_COMM);
+  ierr = ct_send(full_msg, full_msg_size, src_remote_image);
   chk_err(ierr);
 
   {
@@ -6335,19 +9070,10 @@ PREFIX(transfer_between_remotes)(
            dst_image_index, dst_msg->dest_tag);
   }
 
-  if (running_accesses == rat)
-    running_accesses = rat->next;
-  else
-  {
-    struct running_accesses_t *pra = running_accesses;
-    for (; pra && pra->next != rat; pra = pra->next)
-      ;
-    pra->next = rat->next;
-  }
-  free(rat);
+  running_access_release(full_msg->ra_id);
 
   if (free_msg)
-    free(full_msg);
+    bounce_release(full_msg);
 
   dprint("done with transfer_between_remotes.\n");
 }
@@ -6389,6 +9115,7 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
   gfc_max_dim_descriptor_t src_desc;
   gfc_descriptor_t *src = (gfc_descriptor_t *)&src_desc;
   caf_reference_t *riter = refs;
+  struct ref_plan_step_t *step;
   long delta;
   ptrdiff_t data_offset = 0, desc_offset = 0;
   /* Reallocation of dst.data is needed (e.g., array to small). */
@@ -6412,31 +9139,15 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
   if (stat)
     *stat = 0;
 
-  MPI_Group current_team_group, win_group;
-  int global_dynamic_win_rank, memptr_win_rank;
-  ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(global_dynamic_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){image_index - 1}, win_group,
-                                   &global_dynamic_win_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(mpi_token->memptr_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){image_index - 1}, win_group,
-                                   &memptr_win_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
+  const int global_dynamic_win_rank = win_rank(NULL, image_index - 1),
+            memptr_win_rank
+            = win_rank(mpi_token->memptr_win_ranks, image_index - 1);
 
   check_image_health(global_dynamic_win_rank, stat);
 
+  ref_plan_begin();
+  step = ref_plan_bind(mpi_token, refs, 0, global_dynamic_win_rank)->step;
+
   dprint("Entering get_by_ref(may_require_tmp = %d), win_rank = %d, "
          "global_rank = %d.\n",
          may_require_tmp, memptr_win_rank, global_dynamic_win_rank);
@@ -6459,13 +9170,10 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
           remote_base_memptr = remote_memptr;
           if (access_data_through_global_win)
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(&remote_memptr, stdptr_size, MPI_BYTE,
-                           global_dynamic_win_rank,
-                           MPI_Aint_add((MPI_Aint)remote_memptr, data_offset),
-                           stdptr_size, MPI_BYTE, global_dynamic_win);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
+            ierr = get_ref_meta(
+                &remote_memptr, stdptr_size, riter, global_dynamic_win,
+                global_dynamic_win_rank,
+                MPI_Aint_add((MPI_Aint)remote_memptr, data_offset));
             chk_err(ierr);
             dprint("global_win access: remote_memptr(old) = %p, "
                    "remote_memptr(new) = %p, offset = %zd.\n",
@@ -6476,13 +9184,10 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
           }
           else
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(&remote_memptr, stdptr_size, MPI_BYTE,
-                           memptr_win_rank, data_offset, stdptr_size, MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(&remote_memptr, stdptr_size, riter,
+                                mpi_token->memptr_win, memptr_win_rank,
+                                data_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             dprint("get(custom_token %d): remote_memptr(old) = %p, "
                    "remote_memptr(new) = %p, offset = %zd\n",
                    mpi_token->memptr_win, remote_base_memptr, remote_memptr,
@@ -6505,15 +9210,10 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
          * all images, which is taken care of in the else part. */
         if (access_data_through_global_win)
         {
-          /* Compute the ref_rank here and while doing so also figure whether
-           * only a scalar result is expected (all refs are CAF_SINGLE). */
-          for (ref_rank = 0; riter->u.a.mode[ref_rank] != CAF_ARR_REF_NONE;
-               ++ref_rank)
-          {
-            non_scalar_array_ref_expected
-                = non_scalar_array_ref_expected
-                  || riter->u.a.mode[ref_rank] != CAF_ARR_REF_SINGLE;
-          }
+          /* The plan knows the ref_rank and whether only a scalar result is
+           * expected (all refs are CAF_SINGLE). */
+          ref_rank = step->rank;
+          non_scalar_array_ref_expected = !step->scalar;
           /* Get the remote descriptor and use the stack to store it. Note,
            * src may be pointing to mpi_token->desc therefore it needs to be
            * reset here. */
@@ -6525,28 +9225,21 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
                    "get_size = %zd, rank = %d\n",
                    remote_base_memptr, desc_offset, ref_rank, datasize,
                    global_dynamic_win_rank);
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(
-                src, datasize, MPI_BYTE, global_dynamic_win_rank,
-                MPI_Aint_add((MPI_Aint)remote_base_memptr, desc_offset),
-                datasize, MPI_BYTE, global_dynamic_win);
+            ierr = get_ref_meta(
+                src, datasize, riter, global_dynamic_win,
+                global_dynamic_win_rank,
+                MPI_Aint_add((MPI_Aint)remote_base_memptr, desc_offset));
             chk_err(ierr);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
           }
           else
           {
             dprint(
                 "remote desc fetch from win %d, offset = %td, ref_rank = %zd\n",
                 mpi_token->memptr_win, desc_offset, ref_rank);
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(src, sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           memptr_win_rank, desc_offset,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(src, sizeof_desc_for_rank(ref_rank), riter,
+                                mpi_token->memptr_win, memptr_win_rank,
+                                desc_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             access_desc_through_global_win = true;
           }
         }
@@ -6556,14 +9249,7 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
           /* Figure if a none scalar array ref is expected, which is important
            * to know beforehand, because else the descriptor of the destination
            * array may be errorneously constructed. */
-          for (i = 0; riter->u.a.mode[i] != CAF_ARR_REF_NONE; ++i)
-          {
-            if (riter->u.a.mode[i] != CAF_ARR_REF_SINGLE)
-            {
-              non_scalar_array_ref_expected = true;
-              break;
-            }
-          }
+          non_scalar_array_ref_expected = !step->scalar;
         }
 
 #ifdef EXTRA_DEBUG_OUTPUT
@@ -6763,18 +9449,10 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
         }
         break;
       case CAF_REF_STATIC_ARRAY:
-        non_scalar_array_ref_expected = false;
         /* Figure if a none scalar array ref is expected, which is important
          * to know beforehand, because else the descriptor of the destination
          * array may be errorneously constructed. */
-        for (i = 0; riter->u.a.mode[i] != CAF_ARR_REF_NONE; ++i)
-        {
-          if (riter->u.a.mode[i] != CAF_ARR_REF_SINGLE)
-          {
-            non_scalar_array_ref_expected = true;
-            break;
-          }
-        }
+        non_scalar_array_ref_expected = !step->scalar;
 
         for (i = 0; riter->u.a.mode[i] != CAF_ARR_REF_NONE; ++i)
         {
@@ -6932,6 +9610,7 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
     }
     src_size = riter->item_size;
     riter = riter->next;
+    ++step;
   }
   if (size == 0 || src_size == 0)
     return;
@@ -6975,6 +9654,7 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
 #endif
   i = 0;
   dprint("get_by_ref() calling get_for_ref.\n");
+  access_batch_begin(false);
   get_for_ref(refs, &i, dst_index, mpi_token, dst, mpi_token->desc,
               dst->base_addr, remote_memptr, 0, NULL, 0, dst_kind, src_kind, 0,
               0, 1, stat, global_dynamic_win_rank, memptr_win_rank, false, false
@@ -6983,6 +9663,7 @@ PREFIX(get_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *dst,
               src_type
 #endif
   );
+  access_batch_end();
 }
 
 static void
@@ -6993,6 +9674,9 @@ put_data(mpi_caf_token_t *token, MPI_Aint offset, void *sr, int dst_type,
   size_t k;
   int ierr;
   MPI_Win win = (token == NULL) ? global_dynamic_win : token->memptr_win;
+
+  if (token)
+    offset += token->memptr_disp;
 #ifdef EXTRA_DEBUG_OUTPUT
   if (token)
     dprint("(win: %d, image: %d, offset: %zd) <- %p, "
@@ -7008,9 +9692,7 @@ put_data(mpi_caf_token_t *token, MPI_Aint offset, void *sr, int dst_type,
   if (dst_type == src_type && dst_kind == src_kind)
   {
     size_t sz = (dst_size > src_size ? src_size : dst_size) * num;
-    CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image_index, win);
-    ierr = MPI_Put(sr, sz, MPI_BYTE, image_index, offset, sz, MPI_BYTE, win);
-    CAF_Win_unlock(image_index, win);
+    ierr = access_batch_add(true, token, win, image_index, offset, sr, sz);
     chk_err(ierr);
     dprint("sr[] = %d, num = %zd, num bytes = %zd\n", (int)((char *)sr)[0], num,
            sz);
@@ -7018,7 +9700,7 @@ put_data(mpi_caf_token_t *token, MPI_Aint offset, void *sr, int dst_type,
         && dst_size > src_size)
     {
       const size_t trans_size = dst_size / dst_kind - src_size / src_kind;
-      void *pad = alloca(trans_size * dst_kind);
+      void *pad = bounce_alloc(trans_size * dst_kind);
       if (dst_kind == 1)
       {
         memset((void *)(char *)pad, ' ', trans_size);
@@ -7030,55 +9712,38 @@ put_data(mpi_caf_token_t *token, MPI_Aint offset, void *sr, int dst_type,
           ((int32_t *)pad)[k] = (int32_t)' ';
         }
       }
-      CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image_index, win);
-      ierr = MPI_Put(pad, trans_size * dst_kind, MPI_BYTE, image_index,
-                     offset + (src_size / src_kind) * dst_kind,
-                     trans_size * dst_kind, MPI_BYTE, win);
+      ierr = put_bytes(token, win, image_index,
+                       offset + (src_size / src_kind) * dst_kind, pad,
+                       trans_size * dst_kind);
       chk_err(ierr);
-      CAF_Win_unlock(image_index, win);
+      bounce_release(pad);
     }
   }
   else if (dst_type == BT_CHARACTER && dst_kind == 1)
   {
-    /* Get the required amount of memory on the stack. */
-    void *dsh = alloca(dst_size);
+    void *dsh = bounce_alloc(dst_size);
     assign_char1_from_char4(dst_size, src_size, dsh, sr);
-    CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image_index, win);
-    ierr = MPI_Put(dsh, dst_size, MPI_BYTE, image_index, offset, dst_size,
-                   MPI_BYTE, win);
+    ierr = put_bytes(token, win, image_index, offset, dsh, dst_size);
     chk_err(ierr);
-    CAF_Win_unlock(image_index, win);
+    bounce_release(dsh);
   }
   else if (dst_type == BT_CHARACTER)
   {
-    /* Get the required amount of memory on the stack. */
-    void *dsh = alloca(dst_size);
+    void *dsh = bounce_alloc(dst_size);
     assign_char4_from_char1(dst_size, src_size, dsh, sr);
-    CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image_index, win);
-    ierr = MPI_Put(dsh, dst_size, MPI_BYTE, image_index, offset, dst_size,
-                   MPI_BYTE, win);
+    ierr = put_bytes(token, win, image_index, offset, dsh, dst_size);
     chk_err(ierr);
-    CAF_Win_unlock(image_index, win);
+    bounce_release(dsh);
   }
   else
   {
-    /* Get the required amount of memory on the stack. */
-    void *dsh = alloca(dst_size * num), *dsh_iter = dsh;
     dprint("type/kind convert %zd items: "
-           "type %d(%d) -> type %d(%d), local buffer: %p\n",
-           num, src_type, src_kind, dst_type, dst_kind, dsh);
-    for (k = 0; k < num; ++k)
-    {
-      convert_type(dsh_iter, dst_type, dst_kind, sr, src_type, src_kind, stat);
-      dsh_iter += dst_size;
-      sr += src_size;
-    }
-    // dprint("dsh[0] = %d\n", ((int *)dsh)[0]);
-    CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image_index, win);
-    ierr = MPI_Put(dsh, dst_size * num, MPI_BYTE, image_index, offset,
-                   dst_size * num, MPI_BYTE, win);
+           "type %d(%d) -> type %d(%d)\n",
+           num, src_type, src_kind, dst_type, dst_kind);
+    ierr = put_converted(token, win, image_index, offset, dst_type, dst_kind,
+                         dst_size, sr, src_type, src_kind, src_size, num,
+                         stat);
     chk_err(ierr);
-    CAF_Win_unlock(image_index, win);
   }
 }
 
@@ -7139,24 +9804,18 @@ send_for_ref(caf_reference_t *ref, size_t *i, size_t src_index,
         {
           if (ds_global)
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(&ds, stdptr_size, MPI_BYTE, global_dynamic_win_rank,
-                           MPI_Aint_add((MPI_Aint)ds, dst_byte_offset),
-                           stdptr_size, MPI_BYTE, global_dynamic_win);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
+            ierr = get_ref_meta(&ds, stdptr_size, ref, global_dynamic_win,
+                                global_dynamic_win_rank,
+                                MPI_Aint_add((MPI_Aint)ds, dst_byte_offset));
             chk_err(ierr);
             desc_global = true;
           }
           else
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(&ds, stdptr_size, MPI_BYTE, memptr_win_rank,
-                           dst_byte_offset, stdptr_size, MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(&ds, stdptr_size, ref, mpi_token->memptr_win,
+                                memptr_win_rank,
+                                dst_byte_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             ds_global = true;
           }
           dst_byte_offset = 0;
@@ -7241,23 +9900,18 @@ send_for_ref(caf_reference_t *ref, size_t *i, size_t src_index,
         rdesc = ds;
         if (ds_global)
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                       global_dynamic_win);
-          ierr = MPI_Get(&ds, stdptr_size, MPI_BYTE, global_dynamic_win_rank,
-                         MPI_Aint_add((MPI_Aint)ds, dst_byte_offset),
-                         stdptr_size, MPI_BYTE, global_dynamic_win);
-          CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
+          ierr = get_ref_meta(&ds, stdptr_size, ref, global_dynamic_win,
+                              global_dynamic_win_rank,
+                              MPI_Aint_add((MPI_Aint)ds, dst_byte_offset));
           chk_err(ierr);
           desc_global = true;
         }
         else
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank, mpi_token->memptr_win);
-          ierr = MPI_Get(&ds, stdptr_size, MPI_BYTE, memptr_win_rank,
-                         dst_byte_offset, stdptr_size, MPI_BYTE,
-                         mpi_token->memptr_win);
+          ierr = get_ref_meta(&ds, stdptr_size, ref, mpi_token->memptr_win,
+                              memptr_win_rank,
+                              dst_byte_offset + mpi_token->memptr_disp);
           chk_err(ierr);
-          CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
           ds_global = true;
         }
         dst_byte_offset = 0;
@@ -7305,25 +9959,17 @@ send_for_ref(caf_reference_t *ref, size_t *i, size_t src_index,
             MPI_Aint disp = MPI_Aint_add((MPI_Aint)rdesc, desc_byte_offset);
             dprint("remote desc fetch from %p, offset = %td, aggreg. = %ld\n",
                    rdesc, desc_byte_offset, disp);
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(&dst_desc_data, sizeof_desc_for_rank(ref_rank),
-                           MPI_BYTE, global_dynamic_win_rank, disp,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           global_dynamic_win);
+            ierr = get_ref_meta(
+                &dst_desc_data, sizeof_desc_for_rank(ref_rank), ref,
+                global_dynamic_win, global_dynamic_win_rank, disp);
             chk_err(ierr);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
           }
           else
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(&dst_desc_data, sizeof_desc_for_rank(ref_rank),
-                           MPI_BYTE, memptr_win_rank, desc_byte_offset,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(&dst_desc_data, sizeof_desc_for_rank(ref_rank),
+                                ref, mpi_token->memptr_win, memptr_win_rank,
+                                desc_byte_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             desc_global = true;
           }
           dst = (gfc_descriptor_t *)&dst_desc_data;
@@ -7691,6 +10337,7 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
   void *remote_memptr = mpi_token->memptr, *remote_base_memptr = NULL;
   gfc_max_dim_descriptor_t dst_desc, temp_src;
   gfc_descriptor_t *dst = (gfc_descriptor_t *)&dst_desc;
+  struct ref_plan_step_t *step;
   caf_reference_t *riter = refs;
   long delta;
   ptrdiff_t data_offset = 0, desc_offset = 0;
@@ -7711,32 +10358,17 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
 
   if (stat)
     *stat = 0;
+  read_cache_write(token);
 
-  MPI_Group current_team_group, win_group;
-  int global_dynamic_win_rank, memptr_win_rank;
-  ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(global_dynamic_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){image_index - 1}, win_group,
-                                   &global_dynamic_win_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(mpi_token->memptr_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){image_index - 1}, win_group,
-                                   &memptr_win_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&current_team_group);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
+  const int global_dynamic_win_rank = win_rank(NULL, image_index - 1),
+            memptr_win_rank
+            = win_rank(mpi_token->memptr_win_ranks, image_index - 1);
 
   check_image_health(global_dynamic_win_rank, stat);
 
+  ref_plan_begin();
+  step = ref_plan_bind(mpi_token, refs, 0, global_dynamic_win_rank)->step;
+
 #ifdef GCC_GE_8
   dprint("Entering send_by_ref(may_require_tmp = %d, dst_type = %d)\n",
          may_require_tmp, dst_type);
@@ -7765,13 +10397,11 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
           {
             dprint("remote_memptr(old) = %p, offset = %zd\n",
                    remote_base_memptr, data_offset);
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(&remote_memptr, stdptr_size, MPI_BYTE,
-                           global_dynamic_win_rank,
-                           MPI_Aint_add((MPI_Aint)remote_memptr, data_offset),
-                           stdptr_size, MPI_BYTE, global_dynamic_win);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
+            ierr = get_ref_meta(
+                &remote_memptr, stdptr_size, riter, global_dynamic_win,
+                global_dynamic_win_rank,
+                MPI_Aint_add((MPI_Aint)remote_memptr, data_offset));
+            chk_err(ierr);
             dprint("remote_memptr(new) = %p\n", remote_memptr);
             chk_err(ierr);
             /* On the second indirection access also the remote descriptor
@@ -7782,13 +10412,10 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
           {
             dprint("remote_memptr(old) = %p, offset = %zd\n",
                    remote_base_memptr, data_offset);
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(&remote_memptr, stdptr_size, MPI_BYTE,
-                           memptr_win_rank, data_offset, stdptr_size, MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(&remote_memptr, stdptr_size, riter,
+                                mpi_token->memptr_win, memptr_win_rank,
+                                data_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             /* All future access is through the global dynamic window. */
             access_data_through_global_win = true;
           }
@@ -7807,9 +10434,7 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
          * which is taken care of in the else part. */
         if (access_data_through_global_win)
         {
-          for (ref_rank = 0; riter->u.a.mode[ref_rank] != CAF_ARR_REF_NONE;
-               ++ref_rank)
-            ;
+          ref_rank = step->rank;
           /* Get the remote descriptor and use the stack to store it
            * Note, dst may be pointing to mpi_token->desc therefore it
            * needs to be reset here. */
@@ -7819,28 +10444,20 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
             dprint("remote desc fetch from %p, offset = %zd, aggreg = %p\n",
                    remote_base_memptr, desc_offset,
                    remote_base_memptr + desc_offset);
-            CAF_Win_lock(MPI_LOCK_SHARED, global_dynamic_win_rank,
-                         global_dynamic_win);
-            ierr = MPI_Get(
-                dst, sizeof_desc_for_rank(ref_rank), MPI_BYTE,
+            ierr = get_ref_meta(
+                dst, sizeof_desc_for_rank(ref_rank), riter, global_dynamic_win,
                 global_dynamic_win_rank,
-                MPI_Aint_add((MPI_Aint)remote_base_memptr, desc_offset),
-                sizeof_desc_for_rank(ref_rank), MPI_BYTE, global_dynamic_win);
+                MPI_Aint_add((MPI_Aint)remote_base_memptr, desc_offset));
             chk_err(ierr);
-            CAF_Win_unlock(global_dynamic_win_rank, global_dynamic_win);
           }
           else
           {
             dprint("remote desc fetch from win %d, offset = %zd\n",
                    mpi_token->memptr_win, desc_offset);
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_win_rank,
-                         mpi_token->memptr_win);
-            ierr = MPI_Get(dst, sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           memptr_win_rank, desc_offset,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           mpi_token->memptr_win);
+            ierr = get_ref_meta(dst, sizeof_desc_for_rank(ref_rank), riter,
+                                mpi_token->memptr_win, memptr_win_rank,
+                                desc_offset + mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_win_rank, mpi_token->memptr_win);
             access_desc_through_global_win = true;
           }
         }
@@ -8085,6 +10702,7 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
     }
     dst_size = riter->item_size;
     riter = riter->next;
+    ++step;
   }
   if (size == 0 || dst_size == 0)
     return;
@@ -8145,6 +10763,7 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
   dprint("calling send_for_ref. num elems: size = %zd, elem size in bytes: "
          "dst_size = %zd\n",
          size, dst_size);
+  access_batch_begin(true);
   send_for_ref(refs, &i, src_index, mpi_token, mpi_token->desc, src,
                remote_memptr, src->base_addr, 0, NULL, 0, dst_kind, src_kind, 0,
                0, 1, stat, global_dynamic_win_rank, memptr_win_rank, false,
@@ -8154,6 +10773,7 @@ PREFIX(send_by_ref)(caf_token_t token, int image_index, gfc_descriptor_t *src,
                dst_type
 #endif
   );
+  access_batch_end();
   if (free_temp_src)
   {
     free(temp_src.base.base_addr);
@@ -8187,12 +10807,17 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
   void *remote_memptr = src_mpi_token->memptr, *remote_base_memptr = NULL;
   gfc_max_dim_descriptor_t src_desc;
   gfc_max_dim_descriptor_t temp_src_desc;
+  struct ref_plan_step_t *step;
   gfc_descriptor_t *src = (gfc_descriptor_t *)&src_desc;
   caf_reference_t *riter = src_refs;
   long delta;
   ptrdiff_t data_offset = 0, desc_offset = 0;
-  MPI_Group current_team_group, win_group;
-  int global_dst_rank, global_src_rank, memptr_dst_rank, memptr_src_rank;
+  const int global_dst_rank = win_rank(NULL, dst_image_index - 1),
+            global_src_rank = win_rank(NULL, src_image_index - 1),
+            memptr_dst_rank
+            = win_rank(dst_mpi_token->memptr_win_ranks, dst_image_index - 1),
+            memptr_src_rank
+            = win_rank(src_mpi_token->memptr_win_ranks, src_image_index - 1);
   /* Set when the first non-scalar array reference is encountered. */
   bool in_array_ref = false;
   /* Set when remote data is to be accessed through the
@@ -8207,44 +10832,14 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
 
   if (src_stat)
     *src_stat = 0;
-
-  ierr = MPI_Comm_group(CAF_COMM_WORLD, &current_team_group);
-  chk_err(ierr);
-
-  ierr = MPI_Win_get_group(global_dynamic_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){src_image_index - 1}, win_group,
-                                   &global_src_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){dst_image_index - 1}, win_group,
-                                   &global_dst_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
-
-  ierr = MPI_Win_get_group(src_mpi_token->memptr_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){src_image_index - 1}, win_group,
-                                   &memptr_src_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
-  ierr = MPI_Win_get_group(dst_mpi_token->memptr_win, &win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_translate_ranks(current_team_group, 1,
-                                   (int[]){dst_image_index - 1}, win_group,
-                                   &memptr_dst_rank);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&win_group);
-  chk_err(ierr);
-  ierr = MPI_Group_free(&current_team_group);
-  chk_err(ierr);
+  read_cache_write(dst_token);
 
   check_image_health(global_src_rank, src_stat);
 
+  ref_plan_begin();
+  step = ref_plan_bind(src_mpi_token, src_refs, 0, global_src_rank)->step;
+  ref_plan_bind(dst_mpi_token, dst_refs, 1, global_dst_rank);
+
   dprint("Entering get_by_ref(may_require_tmp = %d, dst_type = %d(%d), "
          "src_type = %d(%d)).\n",
          may_require_tmp, dst_type, dst_kind, src_type, src_kind);
@@ -8264,12 +10859,10 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
           remote_base_memptr = remote_memptr;
           if (access_data_through_global_win)
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, global_src_rank, global_dynamic_win);
-            ierr = MPI_Get(&remote_memptr, stdptr_size, MPI_BYTE,
-                           global_src_rank,
-                           MPI_Aint_add((MPI_Aint)remote_memptr, data_offset),
-                           stdptr_size, MPI_BYTE, global_dynamic_win);
-            CAF_Win_unlock(global_src_rank, global_dynamic_win);
+            ierr = get_ref_meta(
+                &remote_memptr, stdptr_size, riter, global_dynamic_win,
+                global_src_rank,
+                MPI_Aint_add((MPI_Aint)remote_memptr, data_offset));
             chk_err(ierr);
             /* On the second indirection access also the remote descriptor
              * using the global window. */
@@ -8277,13 +10870,10 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
           }
           else
           {
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_src_rank,
-                         src_mpi_token->memptr_win);
-            ierr = MPI_Get(&remote_memptr, stdptr_size, MPI_BYTE,
-                           memptr_src_rank, data_offset, stdptr_size, MPI_BYTE,
-                           src_mpi_token->memptr_win);
+            ierr = get_ref_meta(&remote_memptr, stdptr_size, riter,
+                                src_mpi_token->memptr_win, memptr_src_rank,
+                                data_offset + src_mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_src_rank, src_mpi_token->memptr_win);
             /* All future access is through the global dynamic window. */
             access_data_through_global_win = true;
           }
@@ -8301,9 +10891,7 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
          * images, which is taken care of in the else part. */
         if (access_data_through_global_win)
         {
-          for (ref_rank = 0; riter->u.a.mode[ref_rank] != CAF_ARR_REF_NONE;
-               ++ref_rank)
-            ;
+          ref_rank = step->rank;
           /* Get the remote descriptor and use the stack to store it. Note,
            * src may be pointing to mpi_token->desc therefore it needs to be
            * reset here. */
@@ -8312,26 +10900,20 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
           {
             dprint("remote desc fetch from %p, offset = %zd\n",
                    remote_base_memptr, desc_offset);
-            CAF_Win_lock(MPI_LOCK_SHARED, global_src_rank, global_dynamic_win);
-            ierr = MPI_Get(
-                src, sizeof_desc_for_rank(ref_rank), MPI_BYTE, global_src_rank,
-                MPI_Aint_add((MPI_Aint)remote_base_memptr, desc_offset),
-                sizeof_desc_for_rank(ref_rank), MPI_BYTE, global_dynamic_win);
+            ierr = get_ref_meta(
+                src, sizeof_desc_for_rank(ref_rank), riter, global_dynamic_win,
+                global_src_rank,
+                MPI_Aint_add((MPI_Aint)remote_base_memptr, desc_offset));
             chk_err(ierr);
-            CAF_Win_unlock(global_src_rank, global_dynamic_win);
           }
           else
           {
             dprint("remote desc fetch from win %d, offset = %zd\n",
                    src_mpi_token->memptr_win, desc_offset);
-            CAF_Win_lock(MPI_LOCK_SHARED, memptr_src_rank,
-                         src_mpi_token->memptr_win);
-            ierr = MPI_Get(src, sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           memptr_src_rank, desc_offset,
-                           sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                           src_mpi_token->memptr_win);
+            ierr = get_ref_meta(src, sizeof_desc_for_rank(ref_rank), riter,
+                                src_mpi_token->memptr_win, memptr_src_rank,
+                                desc_offset + src_mpi_token->memptr_disp);
             chk_err(ierr);
-            CAF_Win_unlock(memptr_src_rank, src_mpi_token->memptr_win);
             access_desc_through_global_win = true;
           }
         }
@@ -8492,6 +11074,7 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
     } // switch
     src_size = riter->item_size;
     riter = riter->next;
+    ++step;
   }
   if (size == 0 || src_size == 0)
     return;
@@ -8551,6 +11134,7 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
 #endif
   i = 0;
   dprint("calling get_for_ref.\n");
+  access_batch_begin(false);
   get_for_ref(src_refs, &i, dst_index, src_mpi_token,
               (gfc_descriptor_t *)&temp_src_desc, src_mpi_token->desc,
               temp_src_desc.base.base_addr, remote_memptr, 0, NULL, 0, dst_kind,
@@ -8561,10 +11145,12 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
               src_type
 #endif
   );
+  access_batch_end();
   dprint("calling send_for_ref. num elems: size = %zd, elem size in bytes: "
          "src_size = %zd\n",
          size, src_size);
   i = 0;
+  access_batch_begin(true);
 
   send_for_ref(dst_refs, &i, src_index, dst_mpi_token, dst_mpi_token->desc,
                (gfc_descriptor_t *)&temp_src_desc, dst_mpi_token->memptr,
@@ -8575,6 +11161,7 @@ PREFIX(sendget_by_ref)(caf_token_t dst_token, int dst_image_index,
                dst_type
 #endif
   );
+  access_batch_end();
 }
 
 int
@@ -8585,9 +11172,10 @@ PREFIX(is_present)(caf_token_t token, int image_index, caf_reference_t *refs)
       = "Unexpected end of references in caf_is_present.";
   const char remotesInnerRefNA[]
       = "Memory referenced on the remote image is not allocated.";
-  const int ptr_size = sizeof(void *);
-  const int remote_image = image_index - 1;
   mpi_caf_token_t *mpi_token = (mpi_caf_token_t *)token;
+  const int global_dynamic_win_rank = win_rank(NULL, image_index - 1),
+            memptr_win_rank
+            = win_rank(mpi_token->memptr_win_ranks, image_index - 1);
   ptrdiff_t local_offset = 0;
   void *remote_memptr = NULL, *remote_base_memptr = NULL;
   bool carryOn = true, firstDesc = true;
@@ -8597,6 +11185,11 @@ PREFIX(is_present)(caf_token_t token, int image_index, caf_reference_t *refs)
   gfc_max_dim_descriptor_t src_desc;
   caf_array_ref_t array_ref;
 
+  /* Bind the access plan, so that repeated inquiries of the same components
+   * take the remote pointers and descriptors from the memo. */
+  ref_plan_begin();
+  ref_plan_bind(mpi_token, refs, 0, global_dynamic_win_rank);
+
   while (carryOn && riter)
   {
     switch (riter->type)
@@ -8604,12 +11197,11 @@ PREFIX(is_present)(caf_token_t token, int image_index, caf_reference_t *refs)
       case CAF_REF_COMPONENT:
         if (riter->u.c.caf_token_offset)
         {
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, mpi_token->memptr_win);
-          ierr = MPI_Get(&remote_memptr, ptr_size, MPI_BYTE, remote_image,
-                         local_offset + riter->u.c.offset, ptr_size, MPI_BYTE,
-                         mpi_token->memptr_win);
+          ierr = get_ref_meta(&remote_memptr, stdptr_size, riter,
+                              mpi_token->memptr_win, memptr_win_rank,
+                              local_offset + riter->u.c.offset
+                                  + mpi_token->memptr_disp);
           chk_err(ierr);
-          CAF_Win_unlock(remote_image, mpi_token->memptr_win);
           dprint("Got first remote address %p from offset %zd\n", remote_memptr,
                  local_offset);
           local_offset = 0;
@@ -8705,12 +11297,10 @@ PREFIX(is_present)(caf_token_t token, int image_index, caf_reference_t *refs)
         firstDesc = firstDesc && riter->u.c.caf_token_offset == 0;
         local_offset += riter->u.c.offset;
         remote_base_memptr = remote_memptr + local_offset;
-        CAF_Win_lock(MPI_LOCK_SHARED, remote_image, global_dynamic_win);
-        ierr = MPI_Get(&remote_memptr, ptr_size, MPI_BYTE, remote_image,
-                       (MPI_Aint)remote_base_memptr, ptr_size, MPI_BYTE,
-                       global_dynamic_win);
+        ierr = get_ref_meta(&remote_memptr, stdptr_size, riter,
+                            global_dynamic_win, global_dynamic_win_rank,
+                            (MPI_Aint)remote_base_memptr);
         chk_err(ierr);
-        CAF_Win_unlock(remote_image, global_dynamic_win);
         dprint("Got remote address %p from offset %zd nd base memptr %p\n",
                remote_memptr, local_offset, remote_base_memptr);
         local_offset = 0;
@@ -8740,13 +11330,10 @@ PREFIX(is_present)(caf_token_t token, int image_index, caf_reference_t *refs)
                  "sizeof() %zd\n",
                  ref_rank, mpi_token->memptr_win,
                  sizeof_desc_for_rank(ref_rank));
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, mpi_token->memptr_win);
-          ierr = MPI_Get(&src_desc, sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                         remote_image, local_offset,
-                         sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                         mpi_token->memptr_win);
+          ierr = get_ref_meta(&src_desc, sizeof_desc_for_rank(ref_rank), riter,
+                              mpi_token->memptr_win, memptr_win_rank,
+                              local_offset + mpi_token->memptr_disp);
           chk_err(ierr);
-          CAF_Win_unlock(remote_image, mpi_token->memptr_win);
           firstDesc = false;
         }
         else
@@ -8759,13 +11346,10 @@ PREFIX(is_present)(caf_token_t token, int image_index, caf_reference_t *refs)
           dprint("Getting remote descriptor of rank %zd from: %p, "
                  "sizeof() %zd\n",
                  ref_rank, remote_base_memptr, sizeof_desc_for_rank(ref_rank));
-          CAF_Win_lock(MPI_LOCK_SHARED, remote_image, global_dynamic_win);
-          ierr = MPI_Get(&src_desc, sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                         remote_image, (MPI_Aint)remote_base_memptr,
-                         sizeof_desc_for_rank(ref_rank), MPI_BYTE,
-                         global_dynamic_win);
+          ierr = get_ref_meta(&src_desc, sizeof_desc_for_rank(ref_rank), riter,
+                              global_dynamic_win, global_dynamic_win_rank,
+                              (MPI_Aint)remote_base_memptr);
           chk_err(ierr);
-          CAF_Win_unlock(remote_image, global_dynamic_win);
         }
 #ifdef EXTRA_DEBUG_OUTPUT
         {
@@ -8919,9 +11503,7 @@ sync_images_internal(int count, int images[], int *stat, char *errmsg,
       images = images_full;
     }
 
-#if defined(NONBLOCKING_PUT) && !defined(CAF_MPI_LOCK_UNLOCK)
-    explicit_flush();
-#endif
+    pending_accesses_complete();
 
 #ifdef WITH_FAILED_IMAGES
     /* Provoke detecting process fails. */
@@ -8997,6 +11579,7 @@ sync_images_internal(int count, int images[], int *stat, char *errmsg,
         break;
 #endif // WITH_FAILED_IMAGES
     }
+    shared_memory_fence();
   }
 
 sync_images_err_chk:
@@ -9562,6 +12145,9 @@ PREFIX(lock)(caf_token_t token, size_t index, int image_index,
              int *acquired_lock, int *stat, char *errmsg, charlen_t errmsg_len)
 {
   MPI_Win *p = TOKEN(token);
+  /* Lock variables on the symmetric heap do not start at displacement zero,
+   * but are always aligned to an int. */
+  index += TOKEN_DISP(token) / sizeof(int);
   mutex_lock(*p, (image_index == 0) ? caf_this_image : image_index, index, stat,
              acquired_lock, errmsg, errmsg_len);
 }
@@ -9571,6 +12157,7 @@ PREFIX(unlock)(caf_token_t token, size_t index, int image_index, int *stat,
                char *errmsg, charlen_t errmsg_len)
 {
   MPI_Win *p = TOKEN(token);
+  index += TOKEN_DISP(token) / sizeof(int);
   mutex_unlock(*p, (image_index == 0) ? caf_this_image : image_index, index,
                stat, errmsg, errmsg_len);
 }
@@ -9586,6 +12173,9 @@ PREFIX(atomic_define)(caf_token_t token, size_t offset, int image_index,
   MPI_Datatype dt;
   int ierr = 0, image = (image_index != 0) ? image_index - 1 : mpi_this_image;
 
+  /* Make the offset relative to the start of the window. */
+  offset += TOKEN_DISP(token);
+
   selectType(kind, &dt);
 
 #if MPI_VERSION >= 3
@@ -9617,6 +12207,9 @@ PREFIX(atomic_ref)(caf_token_t token, size_t offset, int image_index,
   MPI_Datatype dt;
   int ierr = 0, image = (image_index != 0) ? image_index - 1 : mpi_this_image;
 
+  /* Make the offset relative to the start of the window. */
+  offset += TOKEN_DISP(token);
+
   selectType(kind, &dt);
 
 #if MPI_VERSION >= 3
@@ -9648,6 +12241,9 @@ PREFIX(atomic_cas)(caf_token_t token, size_t offset, int image_index, void *old,
   MPI_Datatype dt;
   int ierr = 0, image = (image_index != 0) ? image_index - 1 : mpi_this_image;
 
+  /* Make the offset relative to the start of the window. */
+  offset += TOKEN_DISP(token);
+
   selectType(kind, &dt);
 
 #if MPI_VERSION >= 3
@@ -9679,6 +12275,9 @@ PREFIX(atomic_op)(int op, caf_token_t token, size_t offset, int image_index,
   MPI_Win *p = TOKEN(token);
   int image = (image_index != 0) ? image_index - 1 : mpi_this_image;
 
+  /* Make the offset relative to the start of the window. */
+  offset += TOKEN_DISP(token);
+
 #if MPI_VERSION >= 3
   old = malloc(kind);
   selectType(kind, &dt);
@@ -9738,9 +12337,11 @@ PREFIX(event_post)(caf_token_t token, size_t index, int image_index, int *stat,
     *stat = 0;
 
 #if MPI_VERSION >= 3
+  pending_accesses_complete();
   CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image, *p);
-  ierr = MPI_Accumulate(&value, 1, MPI_INT, image, index * sizeof(int), 1,
-                        MPI_INT, MPI_SUM, *p);
+  ierr = MPI_Accumulate(&value, 1, MPI_INT, image,
+                        TOKEN_DISP(token) + index * sizeof(int), 1, MPI_INT,
+                        MPI_SUM, *p);
   chk_err(ierr);
   CAF_Win_unlock(image, *p);
 #else // MPI_VERSION
@@ -9778,11 +12379,15 @@ PREFIX(event_wait)(caf_token_t token, size_t index, int until_count, int *stat,
 
   if (stat != NULL)
     *stat = 0;
+  pending_accesses_complete();
 
   ierr = MPI_Win_get_attr(*p, MPI_WIN_BASE, &var, &flag);
   chk_err(ierr);
+  var = (int *)((char *)var + TOKEN_DISP(token));
 
-  MPI_Win_lock_all(MPI_MODE_NOCHECK, *p);
+  /* With the lock_all epoch model the window is locked already. */
+  if (!caf_epoch_lock_all)
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, *p);
   for (i = 0; i < spin_loop_max; ++i)
   {
     ierr = MPI_Win_sync(*p);
@@ -9807,12 +12412,15 @@ PREFIX(event_wait)(caf_token_t token, size_t index, int until_count, int *stat,
 
   newval = -until_count;
 
-  MPI_Win_unlock_all(*p);
+  if (!caf_epoch_lock_all)
+    MPI_Win_unlock_all(*p);
   CAF_Win_lock(MPI_LOCK_SHARED, image, *p);
-  ierr = MPI_Fetch_and_op(&newval, &old, MPI_INT, image, index * sizeof(int),
-                          MPI_SUM, *p);
+  ierr = MPI_Fetch_and_op(&newval, &old, MPI_INT, image,
+                          TOKEN_DISP(token) + index * sizeof(int), MPI_SUM, *p);
   chk_err(ierr);
   CAF_Win_unlock(image, *p);
+  /* The loads after the wait must see the stores before the post. */
+  shared_memory_fence();
 
   check_image_health(image, stat);
 
@@ -9843,8 +12451,9 @@ PREFIX(event_query)(caf_token_t token, size_t index, int image_index,
 
 #if MPI_VERSION >= 3
   CAF_Win_lock(MPI_LOCK_EXCLUSIVE, image, *p);
-  ierr = MPI_Fetch_and_op(NULL, count, MPI_INT, image, index * sizeof(int),
-                          MPI_NO_OP, *p);
+  ierr = MPI_Fetch_and_op(NULL, count, MPI_INT, image,
+                          TOKEN_DISP(token) + index * sizeof(int), MPI_NO_OP,
+                          *p);
   chk_err(ierr);
   CAF_Win_unlock(image, *p);
 #else // MPI_VERSION
@@ -9991,7 +12600,7 @@ PREFIX(image_status)(int image)
       ierr = MPI_Get(&status, 1, MPI_INT, image - 1, 0, 1, MPI_INT, *stat_tok);
       chk_err(ierr);
       dprint("Image status of image #%d is: %d\n", image, status);
-      CAF_Win_unlock(image - 1, *stat_tok);
+      CAF_Win_unlock_local(image - 1, *stat_tok);
       image_stati[image - 1] = status;
     }
     else if (status == MPIX_ERR_PROC_FAILED)
@@ -10161,6 +12770,7 @@ PREFIX(form_team)(int team_id, caf_team_t *team,
   MPI_Comm current_comm = CAF_COMM_WORLD;
   int ierr;
 
+  pending_accesses_complete();
   newcomm = (MPI_Comm *)calloc(1, sizeof(MPI_Comm));
   ierr = MPI_Comm_split(current_comm, team_id, mpi_this_image, newcomm);
   chk_err(ierr);
@@ -10212,11 +12822,13 @@ PREFIX(change_team)(caf_team_t *team, int coselector __attribute__((unused)))
   tmp_team = tmp_used->team_list_elem->team;
   tmp_comm = (MPI_Comm *)tmp_team;
   CAF_COMM_WORLD = *tmp_comm;
+  pending_accesses_complete();
   int ierr = MPI_Comm_rank(*tmp_comm, &mpi_this_image);
   chk_err(ierr);
   caf_this_image = mpi_this_image + 1;
   ierr = MPI_Comm_size(*tmp_comm, &caf_num_images);
   chk_err(ierr);
+  team_ranks_update();
   ierr = MPI_Barrier(*tmp_comm);
   chk_err(ierr);
 }
@@ -10244,6 +12856,278 @@ PREFIX(team_number)(caf_team_t *team)
     return used_teams->team_list_elem->team_id; /* current team */
 }
 
+#ifdef GCC_GE_7
+/* Find where the size bytes at addr in the memory of a coarray, or of an
+ * allocatable component of a derived type coarray, on this image are on image
+ * image_index.  Sets the token and window, NULL and global_dynamic_win for a
+ * component, and the rank and displacement in the window.  The address of a
+ * component on the other image is read from its descriptor there.  Aborts,
+ * when addr is not in a coarray or image_index is not valid. */
+static void
+async_locate(void *addr, size_t size, int image_index, caf_token_t *token,
+             MPI_Win *win, int *rank, MPI_Aint *disp, const char *caller)
+{
+  struct caf_token_entry_t *entry;
+  mpi_caf_slave_token_t *slave_token;
+  void *remote_mem;
+  int ierr;
+
+  if (image_index < 1 || image_index > caf_num_images)
+    caf_runtime_error("%s: image %d is not in the current team", caller,
+                      image_index);
+  entry = token_registry_find_mem(&caf_allocated_tokens, addr, size);
+  if (entry)
+  {
+    mpi_caf_token_t *mpi_token = entry->token;
+
+    *token = mpi_token;
+    *win = mpi_token->memptr_win;
+    *rank = win_rank(mpi_token->memptr_win_ranks, image_index - 1);
+    *disp = mpi_token->memptr_disp + ((char *)addr - (char *)entry->mem);
+    return;
+  }
+
+  entry = token_registry_find_mem(&caf_allocated_slave_tokens, addr, size);
+  if (entry == NULL)
+    caf_runtime_error("%s: the memory at %p is not part of a coarray", caller,
+                      addr);
+  slave_token = entry->token;
+  if (slave_token->desc == NULL)
+    caf_runtime_error("%s: scalar allocatable components are not supported",
+                      caller);
+  /* The descriptor is part of the object holding the component. */
+  async_locate(&slave_token->desc->base_addr, sizeof(void *), image_index,
+               token, win, rank, disp, caller);
+  ierr = get_bytes(*token, *win, *rank, *disp, &remote_mem, sizeof(void *));
+  chk_err(ierr);
+  *token = NULL;
+  *win = global_dynamic_win;
+  *rank = win_rank(NULL, image_index - 1);
+  *disp = (MPI_Aint)remote_mem + ((char *)addr - (char *)entry->mem);
+}
+
+#if MPI_VERSION >= 3
+/* Return the slot in async_requests of the transfer handle or -1, when the
+ * transfer has been completed already. */
+static int
+async_request_slot(int handle)
+{
+  const int slot = handle & ((1 << ASYNC_HANDLE_SLOT_BITS) - 1);
+
+  if (handle < 0 || slot >= async_requests_size
+      || async_requests[slot].win == MPI_WIN_NULL
+      || async_requests[slot].generation != handle >> ASYNC_HANDLE_SLOT_BITS)
+    return -1;
+  return slot;
+}
+#endif
+
+/* Start the transfer of size bytes between buf and displacement disp of win on
+ * rank.  Token is the one win belongs to or NULL.  Returns the handle of the
+ * transfer or -1, when it has been completed already. */
+static int
+async_start(caf_token_t token, MPI_Win win, int rank, MPI_Aint disp, void *buf,
+            size_t size, bool put)
+{
+  void *remote = local_address(token, win, rank, disp);
+  int ierr;
+
+  if (remote)
+  {
+    if (put)
+      memcpy(remote, buf, size);
+    else
+      memcpy(buf, remote, size);
+    return -1;
+  }
+#if MPI_VERSION >= 3
+  /* Request based transfers need the long-lived epochs of the lock_all model.
+   * With the lock model the transfer is completed right away. */
+  if (caf_epoch_lock_all && size > 0)
+  {
+    const size_t chunk = transfer_chunk_size();
+    const int count = (size - 1) / chunk + 1;
+    async_request_t *ar;
+    size_t done, n;
+    int slot, i;
+
+    for (slot = 0; slot < async_requests_size; ++slot)
+      if (async_requests[slot].win == MPI_WIN_NULL)
+        break;
+    if (slot == async_requests_size)
+    {
+      if (slot == 1 << ASYNC_HANDLE_SLOT_BITS)
+        caf_runtime_error("co_%s_async: more than %d transfers running",
+                          put ? "put" : "get", slot);
+      async_requests_size = async_requests_size ? 2 * async_requests_size : 16;
+      async_requests = realloc(async_requests,
+                               async_requests_size * sizeof(async_request_t));
+      memset(&async_requests[slot], 0,
+             (async_requests_size - slot) * sizeof(async_request_t));
+      for (i = slot; i < async_requests_size; ++i)
+        async_requests[i].win = MPI_WIN_NULL;
+    }
+    ar = &async_requests[slot];
+    if (ar->capacity < count)
+    {
+      ar->requests = realloc(ar->requests, count * sizeof(MPI_Request));
+      ar->capacity = count;
+    }
+
+    pending_puts_complete(win, rank);
+    for (done = 0, i = 0; done < size; done += n, ++i)
+    {
+      n = MIN(chunk, size - done);
+      if (put)
+        ierr = MPI_Rput((char *)buf + done, n, MPI_BYTE, rank, disp + done, n,
+                        MPI_BYTE, win, &ar->requests[i]);
+      else
+        ierr = MPI_Rget((char *)buf + done, n, MPI_BYTE, rank, disp + done, n,
+                        MPI_BYTE, win, &ar->requests[i]);
+      chk_err(ierr);
+    }
+    /* Later accesses to the memory have to wait for the put. */
+    if (put)
+      pending_puts_record(pending_puts_find(win, true), rank, disp,
+                          disp + (MPI_Aint)size);
+    ar->count = count;
+    ar->win = win;
+    ar->put_rank = put ? rank : -1;
+    ar->generation = (ar->generation + 1) & ASYNC_HANDLE_GENERATION_MASK;
+    ++async_requests_active;
+    dprint("Started async %s of %zd bytes on rank %d, slot %d.\n",
+           put ? "put" : "get", size, rank, slot);
+    return (ar->generation << ASYNC_HANDLE_SLOT_BITS) | slot;
+  }
+#endif
+  if (put)
+    ierr = put_bytes(token, win, rank, disp, buf, size);
+  else
+    ierr = get_bytes(token, win, rank, disp, buf, size);
+  chk_err(ierr);
+  return -1;
+}
+
+/* Language extension: Start getting size bytes of the coarray memory at src
+ * on image image_index into dest without waiting for the transfer to
+ * complete.  Returns the handle to pass to PREFIX(co_wait) or PREFIX(co_test),
+ * which is -1, when the transfer has been completed already.  dest must not
+ * be accessed before the transfer is complete. */
+int
+PREFIX(co_get_async)(void *src, size_t size, int image_index, void *dest)
+{
+  caf_token_t token;
+  MPI_Win win;
+  MPI_Aint disp;
+  int rank;
+
+  async_locate(src, size, image_index, &token, &win, &rank, &disp,
+               "co_get_async");
+  if (image_index == caf_this_image)
+  {
+    memmove(dest, src, size);
+    return -1;
+  }
+  return async_start(token, win, rank, disp, dest, size, false);
+}
+
+/* Language extension: Start putting size bytes from src into the coarray
+ * memory at dest on image image_index.  Returns the handle like
+ * PREFIX(co_get_async).  src must not be modified before the transfer is
+ * complete. */
+int
+PREFIX(co_put_async)(void *dest, size_t size, int image_index, void *src)
+{
+  caf_token_t token;
+  MPI_Win win;
+  MPI_Aint disp;
+  int rank;
+
+  async_locate(dest, size, image_index, &token, &win, &rank, &disp,
+               "co_put_async");
+  read_cache_write(token);
+  if (image_index == caf_this_image)
+  {
+    memmove(dest, src, size);
+    return -1;
+  }
+  return async_start(token, win, rank, disp, src, size, true);
+}
+
+/* Language extension: Wait for the asynchronous transfer handle to
+ * complete. */
+void
+PREFIX(co_wait)(int handle)
+{
+#if MPI_VERSION >= 3
+  const int slot = async_request_slot(handle);
+
+  if (slot >= 0)
+    async_request_complete(slot);
+#endif
+}
+
+/* Language extension: Test whether the asynchronous transfer handle has
+ * completed without blocking.  A completed handle is freed. */
+bool
+PREFIX(co_test)(int handle)
+{
+#if MPI_VERSION >= 3
+  const int slot = async_request_slot(handle);
+  async_request_t *ar;
+  int flag, ierr;
+
+  if (slot < 0)
+    return true;
+  ar = &async_requests[slot];
+  ierr = MPI_Testall(ar->count, ar->requests, &flag, MPI_STATUSES_IGNORE);
+  chk_err(ierr);
+  if (!flag)
+    return false;
+  /* The requests are done, only a put's flush remains. */
+  async_request_complete(slot);
+#endif
+  return true;
+}
+
+/* Return the registry entry of the coarray, whose local memory starts at addr.
+ * Aborts, when there is none. */
+static struct caf_token_entry_t *
+cache_entry(void *addr, const char *caller)
+{
+  struct caf_token_entry_t *entry
+      = token_registry_find_mem(&caf_allocated_tokens, addr, 1);
+
+  if (entry == NULL)
+    caf_runtime_error("%s: the memory at %p is not part of a coarray", caller,
+                      addr);
+  return entry;
+}
+
+/* Language extension: Keep the data of the coarray, whose local memory starts
+ * at addr, read from other images in the read cache until PREFIX(co_cache_end)
+ * is called for it.  Repeated reads of the same data of an image in a segment
+ * are then satisfied locally.  The program must not read data in the segment
+ * in which another image modifies it, as the standard requires anyway. */
+void
+PREFIX(co_cache_begin)(void *addr)
+{
+  struct caf_token_entry_t *entry = cache_entry(addr, "co_cache_begin");
+
+  ((mpi_caf_token_t *)entry->token)->cached_size = entry->size;
+}
+
+/* Language extension: Stop caching the data of the coarray at addr. */
+void
+PREFIX(co_cache_end)(void *addr)
+{
+  mpi_caf_token_t *token = cache_entry(addr, "co_cache_end")->token;
+
+  read_cache_write(token);
+  token->cached_size = 0;
+}
+#endif // GCC_GE_7
+
 void
 PREFIX(end_team)(caf_team_t *team __attribute__((unused)))
 {
@@ -10252,6 +13136,7 @@ PREFIX(end_team)(caf_team_t *team __attribute__((unused)))
   MPI_Comm *tmp_comm;
   int ierr;
 
+  pending_accesses_complete();
   ierr = MPI_Barrier(CAF_COMM_WORLD);
   chk_err(ierr);
   if (used_teams->prev == NULL)
@@ -10270,6 +13155,7 @@ PREFIX(end_team)(caf_team_t *team __attribute__((unused)))
   caf_this_image = mpi_this_image + 1;
   ierr = MPI_Comm_size(CAF_COMM_WORLD, &caf_num_images);
   chk_err(ierr);
+  team_ranks_update();
 }
 
 void
@@ -10300,6 +13186,7 @@ PREFIX(sync_team)(caf_team_t *team, int unused __attribute__((unused)))
     caf_runtime_error("SYNC TEAM called on team different from current, "
                       "or ancestor, or child");
 
+  pending_accesses_complete();
   int ierr = MPI_Barrier(*tmp_comm);
   chk_err(ierr);
 }
@@ -0,0 +1,63 @@
+! Latency of small coarray puts and gets
+!
+! Measures the time per element-sized put and get to the next image.  Run it
+! once with each epoch model to compare them.  Images on the same node access
+! each other's coarrays through shared memory by default, which bypasses the
+! epochs altogether, so either place the images on different nodes or disable
+! the shared memory, e.g.
+!
+!   export OPENCOARRAYS_SHARED_MEMORY=0
+!   OPENCOARRAYS_EPOCH_MODEL=lock     cafrun -np 2 ./epoch_latency
+!   OPENCOARRAYS_EPOCH_MODEL=lock_all cafrun -np 2 ./epoch_latency
+!
+! The optional first argument gives the number of repetitions.
+
+program epoch_latency
+  use iso_fortran_env, only : int64, real64
+  implicit none
+
+  integer, parameter :: default_reps = 100000, warmup = 1000
+  integer :: x[*], y, reps, i, partner
+  integer(int64) :: t0, t1, rate
+  real(real64) :: put_us, get_us
+  character(len=32) :: arg
+
+  reps = default_reps
+  if (command_argument_count() > 0) then
+    call get_command_argument(1, arg)
+    read(arg, *) reps
+  end if
+
+  x = this_image()
+  partner = merge(1, this_image() + 1, this_image() == num_images())
+  sync all
+
+  if (this_image() == 1) then
+    do i = 1, warmup
+      x[partner] = i
+    end do
+    call system_clock(t0, rate)
+    do i = 1, reps
+      x[partner] = i
+    end do
+    call system_clock(t1)
+    put_us = 1.0e6_real64 * (t1 - t0) / rate / reps
+
+    do i = 1, warmup
+      y = x[partner]
+    end do
+    call system_clock(t0)
+    do i = 1, reps
+      y = x[partner]
+    end do
+    call system_clock(t1)
+    get_us = 1.0e6_real64 * (t1 - t0) / rate / reps
+
+    write(*, '(a,i0,a,i0,a)') "Epoch latency: ", reps, " accesses on ", &
+      num_images(), " images"
+    write(*, '(a,f10.3,a)') "  put: ", put_us, " us"
+    write(*, '(a,f10.3,a)') "  get: ", get_us, " us"
+  end if
+
+  sync all
+end program
@@ -36,6 +36,21 @@ program comp_allocated_2
             call assert(.NOT. allocated(obj[2]%arr(1)%r_comp), 'obj%arr(1)%r_comp should not be allocated')
             call assert(allocated(obj[2]%arr(2)%r_comp), 'obj%arr(2)%r_comp should be allocated')
             call assert(.NOT. allocated(obj[2]%arr(3)%r_comp), 'obj%arr(3)%r_comp should not be allocated')
+        end if
+
+        sync all
+
+        ! The inquiries above must not be answered from stale meta data.
+        if (me == 2) then
+            deallocate(obj%arr(2)%r_comp)
+            allocate(obj%arr(3)%r_comp, source=4.2)
+        end if
+
+        sync all
+
+        if (me == 1) then
+            call assert(.NOT. allocated(obj[2]%arr(2)%r_comp), 'obj%arr(2)%r_comp should be deallocated')
+            call assert(allocated(obj[2]%arr(3)%r_comp), 'obj%arr(3)%r_comp should be allocated')
             print *,'Test passed.'
         end if
         sync all
@@ -0,0 +1,57 @@
+program comp_realloc
+  !! Reallocate a component of a coarray between segments and check that
+  !! coindexed references see the new bounds and data, also when the same
+  !! references have been used before the reallocation.
+
+    implicit none
+    type :: T
+        integer, allocatable :: a(:)
+    end type
+
+    type(T) :: obj[*]
+    integer :: i, k, x, y(3)
+
+    call assert(num_images() .GE. 2, 'Need at least two images.')
+
+    associate(me => this_image())
+        allocate(obj%a(10))
+        obj%a = [(i, i = 1, 10)]
+        sync all
+
+        do k = 1, 3
+            if (me == 1) then
+                do i = 1, 10
+                    x = obj[2]%a(i)
+                    call assert(x == i * k, 'element of obj[2]%a')
+                end do
+                y = obj[2]%a(2:6:2)
+                call assert(all(y == [2, 4, 6] * k), 'section of obj[2]%a')
+            end if
+            sync all
+            if (me == 2) then
+                deallocate(obj%a)
+                allocate(obj%a(-5:20))
+                obj%a(1:10) = [(i * (k + 1), i = 1, 10)]
+            end if
+            sync all
+        end do
+
+        ! Reallocate on this image and reference it in the same segment.
+        deallocate(obj%a)
+        allocate(obj%a(3))
+        obj%a = [7, 8, 9]
+        x = obj[me]%a(2)
+        call assert(x == 8, 'obj[me]%a after reallocation')
+
+        sync all
+        if (me == 1) print *, 'Test passed.'
+    end associate
+contains
+  subroutine assert(assertion,description)
+    logical, intent(in) :: assertion
+    character(len=*), intent(in) :: description
+    if (.not. assertion) error stop "Assertion "// description //" failed."
+  end subroutine
+end program
+
+! vim:sw=4:ts=4:sts=4:
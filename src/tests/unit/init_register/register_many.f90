@@ -0,0 +1,65 @@
+! Unit test for register and deregister.  Keeps enough component tokens
+! registered at once to grow the table of the token registry several times.
+!
+! Copyright (c) 2012-2014, Sourcery, Inc.
+! All rights reserved.
+!
+! Redistribution and use in source and binary forms, with or without
+! modification, are permitted provided that the following conditions are met:
+!     * Redistributions of source code must retain the above copyright
+!       notice, this list of conditions and the following disclaimer.
+!     * Redistributions in binary form must reproduce the above copyright
+!       notice, this list of conditions and the following disclaimer in the
+!       documentation and/or other materials provided with the distribution.
+!     * Neither the name of the Sourcery, Inc., nor the
+!       names of its contributors may be used to endorse or promote products
+!       derived from this software without specific prior written permission.
+!
+! THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+! ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+! WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+! DISCLAIMED. IN NO EVENT SHALL SOURCERY, INC., BE LIABLE FOR ANY
+! DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+! (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+! LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+! ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+! (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+! SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+program register_many
+  implicit none
+  type :: box
+    integer, allocatable :: c(:)
+  end type
+  integer, parameter :: n = 300
+  type(box), allocatable :: o(:)[:]
+  integer :: me, neighbor, pass, i
+
+  me = this_image()
+  neighbor = merge(1, me + 1, me == num_images())
+
+  ! The second pass reuses the slots of the tokens removed by the first.
+  do pass = 1, 2
+    allocate(o(n)[*])
+    do i = 1, n
+      allocate(o(i)%c(i), source=0)
+    end do
+    sync all
+    do i = 1, n
+      o(i)[neighbor]%c(i) = i * me
+    end do
+    sync all
+    do i = 1, n
+      if (o(i)%c(i) /= i * merge(num_images(), me - 1, me == 1)) &
+        error stop "Test failed: put to a component"
+    end do
+    ! Deallocate some components before their coarray.
+    do i = 1, n, 2
+      deallocate(o(i)%c)
+    end do
+    deallocate(o)
+  end do
+
+  sync all
+  if (me == 1) print *, "Test passed."
+end program
@@ -0,0 +1,72 @@
+! Unit test for register procedure. Testing that coarrays carved from the
+! symmetric heap and coarrays exceeding it are remotely accessible.
+!
+! Copyright (c) 2012-2014, Sourcery, Inc.
+! All rights reserved.
+!
+! Redistribution and use in source and binary forms, with or without
+! modification, are permitted provided that the following conditions are met:
+!     * Redistributions of source code must retain the above copyright
+!       notice, this list of conditions and the following disclaimer.
+!     * Redistributions in binary form must reproduce the above copyright
+!       notice, this list of conditions and the following disclaimer in the
+!       documentation and/or other materials provided with the distribution.
+!     * Neither the name of the Sourcery, Inc., nor the
+!       names of its contributors may be used to endorse or promote products
+!       derived from this software without specific prior written permission.
+!
+! THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+! ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+! WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+! DISCLAIMED. IN NO EVENT SHALL SOURCERY, INC., BE LIABLE FOR ANY
+! DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+! (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+! LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+! ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+! (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+! SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+program register_symmetric_heap
+  implicit none
+  integer, parameter :: small=10, medium=2**20, large=24*2**20
+  integer, allocatable :: a(:)[:], b(:)[:], c(:)[:], d(:)[:], huge_arr(:)[:]
+  integer :: me, np, neighbor
+
+  me = this_image()
+  np = num_images()
+  neighbor = merge(1, me + 1, me == np)
+
+  allocate(a(small)[*], source=me)
+  allocate(b(medium)[*], source=2*me)
+  allocate(c(small)[*], source=3*me)
+
+  ! Free a block in the middle and reuse part of it.
+  deallocate(b)
+  allocate(d(medium/2)[*], source=4*me)
+
+  ! Larger than the default heap, so this one gets a window of its own.
+  allocate(huge_arr(large)[*], source=5*me)
+
+  sync all
+  if (any(a(:)[neighbor] /= neighbor)) error stop "Test failed: a"
+  if (any(c(:)[neighbor] /= 3*neighbor)) error stop "Test failed: c"
+  if (d(medium/2)[neighbor] /= 4*neighbor) error stop "Test failed: d"
+  if (huge_arr(large)[neighbor] /= 5*neighbor) error stop "Test failed: huge"
+
+  c(1)[neighbor] = -me
+  d(1)[neighbor] = -me
+  sync all
+  if (c(1) /= -merge(np, me - 1, me == 1)) error stop "Test failed: put c"
+  if (d(1) /= -merge(np, me - 1, me == 1)) error stop "Test failed: put d"
+  if (a(small) /= me) error stop "Test failed: neighbor of c overwritten"
+
+  deallocate(c, a, huge_arr, d)
+
+  ! Everything was released, so this fits again.
+  allocate(b(medium)[*], source=6*me)
+  sync all
+  if (b(medium)[neighbor] /= 6*neighbor) error stop "Test failed: b"
+  deallocate(b)
+
+  if (me == 1) print *, "Test passed."
+end program
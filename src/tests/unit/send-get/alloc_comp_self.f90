@@ -0,0 +1,65 @@
+program alloc_comp_self
+  !! Coindexed references to components of derived type coarrays on the
+  !! executing image, including type conversion, strides and sendget.
+
+    implicit none
+    type :: inner_t
+        integer, allocatable :: v(:)
+    end type
+
+    type :: T
+        real(kind(1.d0)), allocatable :: r(:,:)
+        integer(kind=2), allocatable :: i2(:)
+        type(inner_t), allocatable :: p
+        integer :: s(10)
+    end type
+
+    type(T) :: obj[*]
+    real :: r4(3)
+    integer :: i, me, np, left, iv(4)
+
+    me = this_image()
+    np = num_images()
+    left = merge(np, me - 1, me == 1)
+
+    allocate(obj%r(4, 5), obj%i2(8), obj%p)
+    allocate(obj%p%v(20))
+    obj%r = reshape([(real(i * me, kind(1.d0)), i = 1, 20)], [4, 5])
+    obj%i2 = [(int(i, 2), i = 1, 8)]
+    obj%p%v = [(i + 100 * me, i = 1, 20)]
+    obj%s = [(i, i = 1, 10)]
+    sync all
+
+    ! Get from self with conversion and a strided section.
+    r4 = obj[me]%r(2, 1:5:2)
+    call assert(all(r4 == real([2, 10, 18] * me)), 'get r(2, 1:5:2)')
+    iv = obj[me]%i2(8:2:-2)
+    call assert(all(iv == [8, 6, 4, 2]), 'get i2(8:2:-2)')
+    iv = obj[me]%p%v(1:4)
+    call assert(all(iv == [(i + 100 * me, i = 1, 4)]), 'get p%v(1:4)')
+
+    ! Put to self with conversion and a strided section.
+    obj[me]%r(1:4:3, 5) = [-1., -2.]
+    call assert(all(obj%r(1:4:3, 5) == [-1.d0, -2.d0]), 'put r(1:4:3, 5)')
+    obj[me]%i2(1:8:2) = [11, 13, 15, 17]
+    call assert(all(obj%i2 == int([11, 2, 13, 4, 15, 6, 17, 8], 2)), &
+                'put i2(1:8:2)')
+    obj[me]%p%v(20:17:-1) = [1, 2, 3, 4]
+    call assert(all(obj%p%v(17:20) == [4, 3, 2, 1]), 'put p%v(20:17:-1)')
+
+    ! Sendget between the own image and the left neighbour.
+    sync all
+    obj[me]%s(1:5) = obj[left]%p%v(6:10)
+    call assert(all(obj%s(1:5) == [(i + 100 * left, i = 6, 10)]), 'sendget')
+
+    sync all
+    if (me == 1) print *, 'Test passed.'
+contains
+  subroutine assert(assertion,description)
+    logical, intent(in) :: assertion
+    character(len=*), intent(in) :: description
+    if (.not. assertion) error stop "Assertion "// description //" failed."
+  end subroutine
+end program
+
+! vim:sw=4:ts=4:sts=4:
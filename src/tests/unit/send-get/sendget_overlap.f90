@@ -0,0 +1,48 @@
+! Test that a sendget whose source and destination overlap on the same
+! remote image gives the result of the assignment, which evaluates the right
+! hand side completely before storing it.
+!
+! Needs three images, because sendget takes shortcuts when the current
+! image takes part in the transfer.  The sections are large to make a
+! transfer, that does not honor the overlap, read elements it already
+! wrote.
+
+program sendget_overlap
+
+  implicit none
+
+  integer, parameter :: n = 2000000, remote = 2
+  integer, allocatable :: a(:)[:]
+  integer :: i
+
+  if (num_images() < 3) error stop "Need at least three images."
+
+  allocate(a(n)[*])
+  a = [(i, i = 1, n)]
+  sync all
+
+  ! Shift by one element.
+  if (this_image() == 1) a(2:n)[remote] = a(1:n-1)[remote]
+  sync all
+  if (this_image() == remote) then
+    if (a(1) /= 1 .or. any(a(2:n) /= [(i, i = 1, n - 1)])) then
+      error stop "Shifted sendget failed."
+    end if
+    a = [(i, i = 1, n)]
+  end if
+  sync all
+
+  ! Shift by one element of a stride two section.
+  if (this_image() == 1) a(3:n:2)[remote] = a(1:n-2:2)[remote]
+  sync all
+  if (this_image() == remote) then
+    if (any(a(1:2) /= [1, 2]) .or. any(a(3:n:2) /= [(i, i = 1, n - 2, 2)]) &
+        .or. any(a(4:n:2) /= [(i, i = 4, n, 2)])) then
+      error stop "Strided shifted sendget failed."
+    end if
+  end if
+
+  sync all
+  if (this_image() == 1) print *, "Test passed."
+
+end program